@@ -0,0 +1,50 @@
+#include "format.h"
+#include "monte_carlo.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+
+// Пакетный прогон: task7_batch [runs] [npcs] [ticks] [seed] [threads]
+// Печатает средние и гистограммы выживших по типам.
+
+int main(int argc, char **argv)
+{
+    const size_t runs = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1000;
+    WorldParams params;
+    if (argc > 2)
+        params.npcs = std::strtoull(argv[2], nullptr, 10);
+    if (argc > 3)
+        params.ticks = std::strtoull(argv[3], nullptr, 10);
+    const std::uint64_t seed = argc > 4 ? std::strtoull(argv[4], nullptr, 10) : 1;
+
+    const size_t threads = argc > 5 ? std::strtoull(argv[5], nullptr, 10)
+                                    : std::max<size_t>(1, std::thread::hardware_concurrency());
+    // parallel_for отдаёт один кусок вызывающему потоку, поэтому пул на один меньше.
+    ThreadPool pool(std::max<size_t>(1, threads) - 1);
+    BatchRunner runner(pool, params);
+
+    const auto start = std::chrono::steady_clock::now();
+    const auto histogram = runner.run(runs, seed);
+    const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+
+    std::string out;
+    out += "Runs: " + std::to_string(histogram.runs) + ", threads: " + std::to_string(pool.size() + 1) +
+           ", time: " + std::to_string(elapsed.count()) + " ms\n";
+    for (auto type : {OrkType, SquirrelType, DruidType})
+    {
+        out += type_name(type);
+        out += ": mean " + std::to_string(histogram.mean(type)) + '\n';
+        const auto &bins = histogram.counts[type];
+        for (size_t k = 0; k < bins.size(); ++k)
+            if (bins[k] != 0)
+                out += "  " + std::to_string(k) + ": " + std::to_string(bins[k]) + '\n';
+    }
+    std::cout << out;
+    return 0;
+}
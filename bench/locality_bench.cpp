@@ -0,0 +1,130 @@
+#include "../include/battle.h"
+#include "../include/locality.h"
+#include "../include/rules.h"
+#include "../include/spatial.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <linux/perf_event.h>
+#include <random>
+#include <string>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <vector>
+
+// Проход поиска пар хищник/жертва (как в move_thread) до и после сортировки по Мортону.
+// Счётчик промахов кэша берётся из perf_event_open, если ядро его даёт; без него
+// печатается только время, и причина разницы остаётся непроверенной.
+
+namespace
+{
+    class CacheMissCounter
+    {
+    public:
+        CacheMissCounter()
+        {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.size = sizeof(attr);
+            attr.config = PERF_COUNT_HW_CACHE_MISSES;
+            attr.disabled = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            fd = static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+        }
+
+        ~CacheMissCounter()
+        {
+            if (fd >= 0)
+                close(fd);
+        }
+
+        bool available() const { return fd >= 0; }
+
+        void start()
+        {
+            if (fd < 0)
+                return;
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+
+        long long stop()
+        {
+            if (fd < 0)
+                return -1;
+            ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+            long long value = 0;
+            if (read(fd, &value, sizeof(value)) != sizeof(value))
+                return -1;
+            return value;
+        }
+
+    private:
+        int fd{-1};
+    };
+
+    size_t proximity_pass(const set_t &npcs, const SpatialIndex &index, std::vector<SpatialHit> &hits)
+    {
+        size_t pairs = 0;
+        for (size_t i = 0; i < npcs.size(); ++i)
+        {
+            const auto &attacker = npcs[i];
+            if (!has_prey(attacker->get_type()))
+                continue;
+            const auto [x, y] = attacker->position();
+            index.within_radius(x, y, static_cast<size_t>(rules_for(attacker->get_type()).kill_distance),
+                                prey_mask(attacker->get_type()), hits);
+            for (const auto &hit : hits)
+                pairs += attacker->is_close(npcs[hit.index], 10);
+        }
+        return pairs;
+    }
+
+    void measure(const char *label, const set_t &npcs, CacheMissCounter &counter)
+    {
+        SpatialIndex index;
+        index.rebuild(npcs);
+        std::vector<SpatialHit> hits;
+        proximity_pass(npcs, index, hits);
+
+        counter.start();
+        const auto start = std::chrono::steady_clock::now();
+        const size_t pairs = proximity_pass(npcs, index, hits);
+        const auto elapsed = std::chrono::steady_clock::now() - start;
+        const long long misses = counter.stop();
+
+        std::printf("%-8s disorder=%.3f pairs=%zu time=%.1f ms cache-misses=%s\n", label, morton_disorder(npcs), pairs,
+                    std::chrono::duration<double, std::milli>(elapsed).count(),
+                    misses >= 0 ? std::to_string(misses).c_str() : "n/a");
+    }
+}
+
+int main(int argc, char **argv)
+{
+    const size_t count = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1000000;
+    const int side = 10000;
+
+    std::vector<std::shared_ptr<IFightObserver>> observers;
+    std::mt19937 rng(1);
+    std::uniform_int_distribution<int> coord(0, side);
+    std::uniform_int_distribution<int> type(1, 3);
+    set_t npcs;
+    npcs.reserve(count);
+    for (size_t i = 0; i < count; ++i)
+        npcs.insert(factory(static_cast<NpcType>(type(rng)), "b" + std::to_string(i), coord(rng), coord(rng), observers));
+
+    CacheMissCounter counter;
+    if (!counter.available())
+        std::printf("perf_event_open unavailable, reporting time only\n");
+
+    measure("before", npcs, counter);
+    sort_by_morton(npcs);
+    measure("after", npcs, counter);
+    return 0;
+}
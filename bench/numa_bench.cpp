@@ -0,0 +1,77 @@
+#include "../include/movement.h"
+#include "../include/packed.h"
+#include "../include/placement.h"
+#include "../include/thread_pool.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <random>
+#include <string>
+
+// Шаг move_packed по большому упакованному миру при разных вариантах размещения памяти.
+// На многоузловой машине выигрыш first_touch + pin_threads виден как падение времени тика;
+// на одном узле размещение вырождается в обычное и время должно совпадать.
+
+namespace
+{
+    constexpr int SIDE = 30000;
+
+    // AnonHugePages процесса в КБ (0, если ядро не сообщает).
+    long long anon_huge_kb()
+    {
+        std::ifstream in("/proc/self/smaps_rollup");
+        std::string key;
+        long long value = 0;
+        while (in >> key >> value)
+        {
+            if (key == "AnonHugePages:")
+                return value;
+            in.ignore(256, '\n');
+        }
+        return 0;
+    }
+
+    void measure(const char *label, const WorldMemoryOptions &options, size_t count, size_t ticks, ThreadPool &pool)
+    {
+        const long long huge_before = anon_huge_kb();
+        PackedWorld world(options);
+        world.reserve(count);
+        std::mt19937 rng(1);
+        std::uniform_int_distribution<int> coord(0, SIDE);
+        for (size_t i = 0; i < count; ++i)
+            world.add(static_cast<NpcType>(1 + i % 3), {}, coord(rng), coord(rng));
+        if (options.first_touch)
+            world.place(pool);
+
+        move_packed(world, SIDE, SIDE, 0, pool);
+        const auto start = std::chrono::steady_clock::now();
+        for (size_t tick = 1; tick <= ticks; ++tick)
+            move_packed(world, SIDE, SIDE, tick, pool);
+        const auto elapsed = std::chrono::steady_clock::now() - start;
+
+        std::printf("%-12s %.2f ms/tick  AnonHugePages +%lld KB\n", label,
+                    std::chrono::duration<double, std::milli>(elapsed).count() / static_cast<double>(ticks),
+                    anon_huge_kb() - huge_before);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    const size_t count = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 8000000;
+    const size_t ticks = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 20;
+    ThreadPool pool;
+
+    const auto &topology = NumaTopology::system();
+    std::printf("records=%zu ticks=%zu threads=%zu numa-nodes=%zu\n", count, ticks, pool.size() + 1, topology.nodes());
+    if (!topology.multi_node())
+        std::printf("single NUMA node: first-touch and pinning fall back to plain placement\n");
+
+    measure("default", {}, count, ticks, pool);
+    measure("placed", {HugePages::Off, true, true}, count, ticks, pool);
+    measure("placed+thp", {HugePages::Transparent, true, true}, count, ticks, pool);
+    measure("placed+huge", {HugePages::Explicit, true, true}, count, ticks, pool);
+    return 0;
+}
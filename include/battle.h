@@ -1,9 +1,18 @@
 #pragma once
 
 #include "factory.h"
+#include "npc_store.h"
+#include "resolver.h"
+#include "rules.h"
+#include "static_observers.h"
+#include "thread_pool.h"
 
+#include <array>
+#include <cstdint>
 #include <ostream>
+#include <span>
 #include <string>
+#include <utility>
 #include <vector>
 
 void print_all(const set_t &array, std::ostream &os);
@@ -12,5 +21,72 @@ set_t load(const std::string &filename, const std::vector<std::shared_ptr<IFight
 
 std::ostream &operator<<(std::ostream &os, const set_t &array);
 
+// Раунд боёв: каждая пара «хищник — жертва» в пределах distance бросает кубики один
+// раз, со стороны хищника; жертва гибнет при attack > defense, то есть с вероятностью
+// 15/36. Исходный перебор всех упорядоченных пар давал хищнику второй бросок, когда
+// очередь доходила до жертвы (1 - (21/36)^2 ~ 0.66 за раунд); это правило сознательно
+// заменено одним броском на пару. Пары без права атаки (can_attack) не рассматриваются
+// и наблюдателей не уведомляют.
 set_t fight(const set_t &array, size_t distance);
+// Параллельный поиск кандидатов по кускам атакующих. Одновременные претензии на одну
+// жертву разрешаются детерминированно: побеждает кандидат с меньшим плотным индексом
+// атакующего (затем меньшим x жертвы), как и в последовательной версии. При одинаковом
+// seed_random() результат совпадает с fight(array, distance).
+set_t fight(const set_t &array, size_t distance, ThreadPool &pool);
+// fight() без рассылки IFightObserver: исходы остаются в resolver.outcomes().
+set_t fight_quiet(const set_t &array, size_t distance, FightResolver &resolver);
+
+// Мир со статическим набором наблюдателей, выбранным при конструировании:
+// ObservedWorld<ConsoleKills, FileKills> или ObservedWorld<> для безголовых прогонов,
+// где рассылки нет вовсе. Подписки IFightObserver самих NPC не вызываются.
+template <class... Obs>
+class ObservedWorld
+{
+public:
+    explicit ObservedWorld(set_t npcs, Observers<Obs...> observers = {})
+        : store(std::move(npcs)), pipeline(std::move(observers)) {}
+
+    set_t &npcs() noexcept { return store; }
+    const set_t &npcs() const noexcept { return store; }
+    Observers<Obs...> &observers() noexcept { return pipeline; }
+
+    // Раунд боёв: броски и смерти те же, что у fight(npcs(), distance).
+    set_t fight(size_t distance)
+    {
+        resolver.reset();
+        auto dead_list = fight_quiet(store, distance, resolver);
+        pipeline.notify(store, resolver.outcomes());
+        return dead_list;
+    }
+
+private:
+    set_t store;
+    Observers<Obs...> pipeline;
+    FightResolver resolver;
+};
+
+// Буферы fight_into, которыми владеет вызывающий. После первого вызова повторные вызовы
+// на мире не больше прежнего (по числу NPC и пар-кандидатов) не выделяют память.
+struct FightBuffers
+{
+    struct BucketEntry
+    {
+        int x;
+        size_t index;
+    };
+
+    std::array<std::vector<BucketEntry>, NPC_TYPE_COUNT> buckets;
+    std::vector<FightCandidate> candidates;
+    FightResolver resolver; // плоский массив «мёртв в этом раунде»
+    std::vector<std::uint32_t> dead;
+
+    void reserve(size_t npcs, size_t candidate_pairs);
+    // Плотные индексы погибших в последнем вызове, в порядке боёв.
+    std::span<const std::uint32_t> deaths() const noexcept { return dead; }
+};
+
+// fight() без set_t на выходе: смерти пишутся в buffers.dead, наблюдатели NPC
+// уведомляются так же. Броски и смерти те же, что у fight(array, distance).
+size_t fight_into(const set_t &array, size_t distance, FightBuffers &buffers);
+
 bool name_exists(const set_t &array, const std::string &name);
@@ -0,0 +1,114 @@
+#pragma once
+
+#include "density.h"
+#include "npc.h"
+#include "npc_store.h"
+#include "spatial.h"
+
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <utility>
+#include <vector>
+
+// Пул кадров корутин: блоки фиксированных размерных классов нарезаются из больших
+// чанков и переиспользуются через free-list, поэтому миллион поведений не дёргает malloc.
+// Списки свободных блоков у каждого потока свои; общий мьютекс берётся только при
+// нарезке нового чанка. Кадр любого встроенного поведения укладывается в FRAME_BUDGET
+// байт (wander — класс 128, остальные — не больше 192), миллион поведений — до ~192 МБ.
+class FramePool
+{
+public:
+    static constexpr size_t FRAME_BUDGET = 192;
+
+    static void *allocate(size_t size);
+    static void deallocate(void *ptr, size_t size) noexcept;
+    static size_t reserved_bytes();
+};
+
+class Behaviour
+{
+public:
+    struct promise_type
+    {
+        std::uint32_t sleep_ticks{0};
+
+        Behaviour get_return_object() noexcept;
+        std::suspend_always initial_suspend() const noexcept { return {}; }
+        std::suspend_always final_suspend() const noexcept { return {}; }
+        void return_void() const noexcept {}
+        void unhandled_exception() const noexcept;
+
+        static void *operator new(size_t size) { return FramePool::allocate(size); }
+        static void operator delete(void *ptr, size_t size) noexcept { FramePool::deallocate(ptr, size); }
+    };
+
+    using handle_t = std::coroutine_handle<promise_type>;
+
+    Behaviour() = default;
+    explicit Behaviour(handle_t h) noexcept : handle(h) {}
+    Behaviour(Behaviour &&other) noexcept : handle(std::exchange(other.handle, {})) {}
+    Behaviour &operator=(Behaviour &&other) noexcept;
+    Behaviour(const Behaviour &) = delete;
+    Behaviour &operator=(const Behaviour &) = delete;
+    ~Behaviour();
+
+    bool done() const noexcept { return !handle || handle.done(); }
+    // Возобновляет корутину, если она не спит; возвращает false, когда поведение завершилось.
+    bool step();
+    const void *frame() const noexcept { return handle ? handle.address() : nullptr; }
+
+private:
+    handle_t handle;
+};
+
+// co_await sleep_ticks(n) — пропустить n тиков; co_await next_tick() — дождаться следующего.
+struct SleepTicks
+{
+    std::uint32_t ticks;
+
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(Behaviour::handle_t h) const noexcept { h.promise().sleep_ticks = ticks; }
+    void await_resume() const noexcept {}
+};
+
+inline SleepTicks next_tick() { return {0}; }
+inline SleepTicks sleep_ticks(std::uint32_t ticks) { return {ticks}; }
+
+struct BehaviourContext
+{
+    int max_x;
+    int max_y;
+    std::mt19937 rng;
+    // Если задана, каждый шаг сразу переносит NPC между ячейками сетки.
+    DensityGrid *density{nullptr};
+};
+
+Behaviour wander(std::shared_ptr<NPC> npc, BehaviourContext &ctx);
+Behaviour patrol(std::shared_ptr<NPC> npc, BehaviourContext &ctx, std::vector<std::pair<int, int>> waypoints);
+Behaviour chase(std::shared_ptr<NPC> npc, BehaviourContext &ctx, std::weak_ptr<NPC> target);
+Behaviour flee(std::shared_ptr<NPC> npc, BehaviourContext &ctx, std::weak_ptr<NPC> threat);
+// Каждый тик идёт к ближайшей жертве из index; index должен быть перестроен по npcs.
+Behaviour hunt(std::shared_ptr<NPC> npc, BehaviourContext &ctx, const SpatialIndex &index, const set_t &npcs);
+
+// Кооперативный планировщик: все поведения возобновляются по очереди в одном потоке на тик.
+class BehaviourScheduler
+{
+public:
+    BehaviourScheduler(int max_x, int max_y, unsigned int seed);
+
+    BehaviourContext &context() noexcept { return ctx; }
+    void spawn(Behaviour behaviour);
+    void reserve(size_t n) { tasks.reserve(n); }
+    void tick();
+    size_t size() const noexcept { return tasks.size(); }
+
+private:
+    void compact();
+
+    BehaviourContext ctx;
+    std::vector<Behaviour> tasks;
+    size_t finished{0};
+};
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "factory.h"
+#include "npc_store.h"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+struct DeltaSaveOptions
+{
+    // Журнал сжимается в новый базовый снимок, когда в нём записей больше,
+    // чем compact_ratio * размер мира.
+    double compact_ratio{0.5};
+};
+
+// Инкрементальные сохранения: базовый снимок в формате save() + журнал изменений
+// (base_path + ".delta"), куда append() дописывает только грязные NPC.
+// Журнал — последовательность сегментов "# segment <n> <count>" и строк
+// "type name x y alive"; NPC сопоставляются по имени, поэтому имена должны быть
+// уникальны (снимок с повторами не загружается). Недописанный последний
+// сегмент (сбой во время записи) при загрузке отбрасывается.
+// Снимок заканчивается строкой "# base <метка>" и сегментом с мёртвыми; журнал
+// начинается с той же метки и применяется только к своему снимку. Снимок пишется
+// в base_path + ".tmp" и подменяет старый через rename(), так что сбой во время
+// сжатия оставляет на диске прежнюю пару или новый снимок без журнала.
+// Удаление из NpcStore без die() не записывается.
+class DeltaSaver
+{
+public:
+    explicit DeltaSaver(std::string base_path, DeltaSaveOptions options = {});
+
+    // Полный снимок: новый базовый файл + пустой журнал; сбрасывает флаги dirty.
+    // При ошибке возвращается false: на диске остаётся согласованная пара (прежняя или
+    // новый снимок без журнала), а следующий append() снова сжимает.
+    bool compact(const set_t &array);
+    // Дописывает сегмент с изменившимися NPC (или сжимает журнал по порогу;
+    // первый вызов без compact() тоже делает полный снимок).
+    // Возвращает число записанных записей изменений.
+    size_t append(const set_t &array);
+
+    const std::string &base_path() const noexcept { return base; }
+    const std::string &delta_path() const noexcept { return delta; }
+    size_t compactions() const noexcept { return compaction_count; }
+    size_t pending_records() const noexcept { return delta_records; }
+
+private:
+    std::string base;
+    std::string delta;
+    DeltaSaveOptions options;
+    size_t segments{0};
+    size_t delta_records{0};
+    size_t compaction_count{0};
+    bool force_compact{true};
+};
+
+// Загружает базовый снимок и применяет к нему журнал; флаги dirty результата сброшены.
+set_t load_with_deltas(const std::string &base_path, const std::vector<std::shared_ptr<IFightObserver>> &observers);
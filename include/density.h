@@ -0,0 +1,55 @@
+#pragma once
+
+#include "npc_store.h"
+#include "rules.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Сетка плотности по типам: счётчики живых NPC в ячейках cell_size x cell_size над
+// [0, width] x [0, height]. Счётчики меняются по одному (add/remove/move за O(1)) прямо
+// в путях движения и смерти; таблицы накопленных сумм пересчитываются лениво при первом
+// запросе после изменений, после чего любой прямоугольник отвечает за O(1).
+// Сетка однопоточная: const-запросы тоже пишут (ленивый пересчёт сумм), поэтому все
+// обращения, включая чтение, вызывающий сериализует сам (в main — density_mutex).
+class DensityGrid
+{
+public:
+    DensityGrid(int width, int height, int cell_size = 1);
+
+    void add(NpcType type, int x, int y);
+    void remove(NpcType type, int x, int y);
+    void move(NpcType type, int from_x, int from_y, int to_x, int to_y);
+    void clear();
+
+    // Полная пересборка по живым NPC за O(N) — для начального заполнения.
+    void rebuild(const set_t &npcs);
+    // Снимает проигравших из исходов FightResolver::resolve (позиция мёртвого NPC уже не меняется).
+    void remove_killed(const NpcStore &npcs, std::span<const FightOutcome> outcomes);
+
+    int columns() const noexcept { return cols; }
+    int rows() const noexcept { return rws; }
+    size_t cell(NpcType type, int cx, int cy) const;
+    // Ячейки [cx0, cx1) x [cy0, cy1), границы обрезаются по сетке.
+    size_t count_cells(NpcType type, int cx0, int cy0, int cx1, int cy1) const;
+    // Мировые координаты, включительно; точность — до ячейки (при cell_size 1 точно).
+    size_t count(NpcType type, int x0, int y0, int x1, int y1) const;
+    size_t total(NpcType type) const noexcept { return totals[type]; }
+
+private:
+    int cell_of(int x, int y) const noexcept;
+    // Пересчитывает sums, если счётчики менялись; из-за него const-запросы не потокобезопасны.
+    void prepare() const;
+
+    int cell_size;
+    int cols;
+    int rws;
+    std::array<std::vector<std::uint32_t>, NPC_TYPE_COUNT> counts;
+    std::array<size_t, NPC_TYPE_COUNT> totals{};
+    // sums[type][(cy) * (cols + 1) + cx] — сумма ячеек [0, cx) x [0, cy).
+    mutable std::array<std::vector<std::uint32_t>, NPC_TYPE_COUNT> sums;
+    mutable bool stale{true};
+};
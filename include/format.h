@@ -0,0 +1,21 @@
+#pragma once
+
+#include "npc.h"
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+std::string_view type_name(NpcType type);
+
+// Дописывают запись в конец out без промежуточных строк; при повторном использовании
+// out с достаточной ёмкостью аллокаций нет.
+void append_npc(std::string &out, const NPC &npc);      // "Ork name {x, y}" — как operator<<
+void append_npc_line(std::string &out, const NPC &npc); // "Ork name (x, y)\n" — как print()
+
+// Сбрасывает буфер в поток одним write, когда он перерос threshold (0 — всегда).
+void flush_buffer(std::ostream &os, std::string &buffer, size_t threshold = 0);
+
+// Переиспользуемый буфер текущего потока для одиночных записей.
+std::string &format_scratch();
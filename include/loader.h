@@ -0,0 +1,36 @@
+#pragma once
+
+#include "factory.h"
+#include "npc_store.h"
+#include "thread_pool.h"
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct NpcRecord
+{
+    NpcType type{Unknown};
+    std::string_view name; // указывает в разбираемый текст
+    int x{0};
+    int y{0};
+};
+
+struct LoadError
+{
+    size_t line; // с 1, как в текстовом редакторе
+    std::string message;
+};
+
+// Разбор текстового сохранения (первая строка — count, затем строки "type name x y").
+// Текст делится на куски по границам строк, каждый кусок разбирается std::from_chars
+// в своём потоке; записи и ошибки сливаются в порядке файла. Строки с ошибками пропускаются.
+// Возвращает объявленный count (0, если заголовок не прочитан).
+size_t parse_npc_records(std::string_view text, ThreadPool &pool, std::vector<NpcRecord> &records,
+                         std::vector<LoadError> &errors);
+
+// Быстрый аналог load(): mmap файла + parse_npc_records + factory() в тех же потоках.
+// Ошибки печатаются в std::cerr с номером строки; берутся первые count корректных записей.
+set_t load_parallel(const std::string &filename, const std::vector<std::shared_ptr<IFightObserver>> &observers,
+                    ThreadPool &pool);
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "npc_store.h"
+
+#include <cstdint>
+
+// Ключ Мортона по (x, y); координаты обрезаются до [0, 65535].
+std::uint32_t morton_key(int x, int y);
+
+// Доля соседних по плотному индексу пар, у которых ключ Мортона убывает:
+// 0 — хранилище упорядочено вдоль кривой, ~0.5 — случайный порядок.
+double morton_disorder(const set_t &npcs);
+
+// Переставляет плотный массив вдоль кривой Мортона; NpcId остаются прежними.
+// Это перестановка порядка обхода, а не памяти: объекты NPC не переезжают, и линейный
+// проход по полям NPC после сортировки читает кучу в менее удачном порядке.
+// Поэтому игровой цикл её не вызывает: это утилита по запросу (например, перед
+// PackedWorld::from_store, чьи записи лежат подряд и выигрывают от порядка обхода).
+void sort_by_morton(set_t &npcs);
+
+// Сортирует, только если morton_disorder() превысил threshold; возвращает true, если сортировал.
+bool resort_if_disordered(set_t &npcs, double threshold);
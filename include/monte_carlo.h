@@ -0,0 +1,57 @@
+#pragma once
+
+#include "rules.h"
+#include "thread_pool.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Параметры одного маленького мира; по умолчанию совпадают с task7
+// (карта 100x100, 50 NPC, 30 с по 10 мс = 3000 тиков).
+struct WorldParams
+{
+    int width{100};
+    int height{100};
+    size_t npcs{50};
+    size_t ticks{3000};
+};
+
+struct RunResult
+{
+    std::array<size_t, NPC_TYPE_COUNT> initial{};
+    std::array<size_t, NPC_TYPE_COUNT> survivors{};
+};
+
+// Распределение выживших по типам: counts[type][k] — сколько прогонов закончились
+// с k выжившими этого типа.
+struct SurvivorHistogram
+{
+    std::array<std::vector<size_t>, NPC_TYPE_COUNT> counts;
+    size_t runs{0};
+
+    void add(const RunResult &result);
+    double mean(NpcType type) const;
+};
+
+// Один прогон: расстановка, затем ticks раз movement + fight по правилам fight().
+// Результат определяется только params и seed.
+RunResult run_world(const WorldParams &params, std::uint64_t seed);
+
+// Гоняет независимые миры на общем пуле. Прогон r получает seed counter_bits(base_seed, r),
+// так что гистограмма не зависит от числа потоков; буферы мира переиспользуются
+// между прогонами одного куска.
+class BatchRunner
+{
+public:
+    BatchRunner(ThreadPool &pool, WorldParams params);
+
+    SurvivorHistogram run(size_t runs, std::uint64_t base_seed);
+    const std::vector<RunResult> &results() const noexcept { return last; }
+
+private:
+    ThreadPool &pool;
+    WorldParams params;
+    std::vector<RunResult> last;
+};
@@ -0,0 +1,16 @@
+#pragma once
+
+#include "packed.h"
+#include "thread_pool.h"
+
+#include <cstdint>
+#include <span>
+
+// Пакетный шаг случайного блуждания по упакованным записям: сдвиги из счётчикового
+// генератора (запись i получает биты counter_bits(seed, i)), шаг по типу из таблицы,
+// обрезка по [0, max_x] x [0, max_y]. Мёртвые записи не двигаются.
+// Результат не зависит от числа потоков.
+void move_packed(std::span<NpcHot> records, int max_x, int max_y, std::uint64_t seed);
+void move_packed(std::span<NpcHot> records, int max_x, int max_y, std::uint64_t seed, ThreadPool &pool);
+// При world.memory_options().pin_threads каждый участок двигается на CPU узла, где лежат его страницы.
+void move_packed(PackedWorld &world, int max_x, int max_y, std::uint64_t seed, ThreadPool &pool);
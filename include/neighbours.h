@@ -0,0 +1,59 @@
+#pragma once
+
+#include "npc_store.h"
+#include "resolver.h"
+#include "rules.h"
+#include "spatial.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Списки соседей Верле: у каждого типа t свой запас смещения slack[t]. Хищник типа A
+// кэширует жертв в радиусе kill_distance(A) + slack[A] + max slack[B] по типам жертв B.
+// Список перестраивается, только когда какой-то NPC типа t сместился больше чем на
+// slack[t] от позиции последней перестройки (или поменялась раскладка хранилища);
+// до тех пор пары в радиусе убийства гарантированно есть в кэше.
+class NeighbourList
+{
+public:
+    using Slack = std::array<double, NPC_TYPE_COUNT>;
+
+    // Общий запас skin: slack[t] = skin / 2 для всех типов, радиус kill_distance + skin.
+    explicit NeighbourList(int skin);
+    explicit NeighbourList(const Slack &slack) : slack(slack) {}
+
+    // Запас на ticks тиков движения каждого типа: slack[t] = ticks * rules_for(t).step.
+    // Быстрые типы не заставляют перестраивать списки каждый тик, медленные не раздувают радиус.
+    static NeighbourList for_ticks(size_t ticks);
+
+    // index должен быть построен по текущим позициям npcs; используется только при
+    // перестройке. Возвращает true, если списки перестраивались.
+    bool update(const set_t &npcs, const SpatialIndex &index);
+    // Пары хищник/жертва в радиусе kill_distance хищника, только из кэшированных списков.
+    void collect_candidates(const set_t &npcs, std::vector<FightCandidate> &out) const;
+    // То же только для хищников с плотными индексами [begin, end).
+    void collect_candidates(const set_t &npcs, std::vector<FightCandidate> &out, size_t begin, size_t end) const;
+
+    size_t rebuilds() const noexcept { return rebuild_count; }
+    size_t cached_pairs() const noexcept { return neighbours.size(); }
+
+private:
+    bool needs_rebuild(const set_t &npcs) const;
+    void rebuild(const set_t &npcs, const SpatialIndex &index);
+
+    struct Anchor
+    {
+        int x;
+        int y;
+    };
+
+    Slack slack;
+    std::vector<Anchor> anchors;
+    std::vector<std::uint32_t> offsets; // соседи хищника i: neighbours[offsets[i] .. offsets[i + 1])
+    std::vector<std::uint32_t> neighbours;
+    std::uint64_t layout{0};
+    size_t rebuild_count{0};
+    std::vector<SpatialHit> hits;
+};
@@ -1,13 +1,15 @@
 #pragma once
 
+#include <atomic>
 #include <cmath>
 #include <cstddef>
+#include <cstdint>
 #include <iostream>
 #include <istream>
 #include <memory>
 #include <mutex>
-#include <set>
 #include <shared_mutex>
+#include <span>
 #include <string>
 #include <utility>
 #include <vector>
@@ -15,8 +17,7 @@
 struct Ork;
 struct Squirrel;
 struct Druid;
-
-using set_t = std::set<std::shared_ptr<class NPC>>;
+class NpcStore;
 
 enum NpcType
 {
@@ -26,12 +27,21 @@ enum NpcType
     DruidType = 3
 };
 
+struct FightOutcome
+{
+    std::uint32_t attacker; // плотные индексы в NpcStore
+    std::uint32_t defender;
+    bool win;
+};
+
 struct IFightObserver
 {
     virtual ~IFightObserver() = default;
     virtual void on_fight(const std::shared_ptr<class NPC> attacker,
                           const std::shared_ptr<class NPC> defender,
                           bool win) = 0;
+    // Все исходы одного пакета; по умолчанию разворачивается в вызовы on_fight.
+    virtual void on_fights(const NpcStore &npcs, std::span<const FightOutcome> outcomes);
 };
 
 class NPC : public std::enable_shared_from_this<NPC>
@@ -48,20 +58,27 @@ public:
     std::pair<int, int> position() const;
 
     void subscribe(const std::shared_ptr<IFightObserver> &observer);
+    const std::vector<std::shared_ptr<IFightObserver>> &get_observers() const noexcept { return observers; }
     void fight_notify(const std::shared_ptr<NPC> &defender, bool win);
 
     virtual bool is_close(const std::shared_ptr<NPC> &other, size_t distance) const;
 
     void move(int shift_x, int shift_y, int max_x, int max_y);
+    void set_position(int x_pos, int y_pos);
     bool is_alive() const;
     void die();
 
+    // Изменился ли NPC (позиция или смерть) с последнего take_dirty(); новые NPC грязные.
+    bool is_dirty() const noexcept { return dirty.load(std::memory_order_relaxed); }
+    bool take_dirty() noexcept { return dirty.exchange(false, std::memory_order_relaxed); }
+
     virtual bool accept(const std::shared_ptr<NPC> &attacker) = 0;
 
     virtual bool fight(const std::shared_ptr<Ork> &other) = 0;
     virtual bool fight(const std::shared_ptr<Squirrel> &other) = 0;
     virtual bool fight(const std::shared_ptr<Druid> &other) = 0;
     virtual void print() const = 0;
+    void print_to(std::ostream &os) const;
 
     virtual void save(std::ostream &os) const;
 
@@ -73,10 +90,12 @@ protected:
     int x{0};
     int y{0};
     bool alive{true};
+    std::atomic<bool> dirty{true};
     std::vector<std::shared_ptr<IFightObserver>> observers;
     mutable std::shared_mutex state_mutex;
 };
 
 int roll_dice();
+std::uint64_t draw_seed();
 void seed_random(unsigned int seed);
 std::mutex &console_mutex();
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "npc.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+struct NpcId
+{
+    static constexpr std::uint32_t invalid_index = 0xFFFFFFFFu;
+
+    std::uint32_t index{invalid_index};
+    std::uint32_t generation{0};
+
+    bool valid() const noexcept { return index != invalid_index; }
+    friend bool operator==(const NpcId &, const NpcId &) = default;
+};
+
+// Slot map: плотный массив для обхода + слоты с поколениями для стабильных id.
+// Порядок обхода — порядок вставки (erase переносит последний элемент на место удалённого).
+class NpcStore
+{
+public:
+    using value_type = std::shared_ptr<NPC>;
+    using const_iterator = std::vector<value_type>::const_iterator;
+
+    std::pair<NpcId, bool> insert(const value_type &npc);
+    bool erase(NpcId id);
+    size_t erase(const value_type &npc);
+    void clear();
+    void reserve(size_t n);
+    // order[k] — старый плотный индекс элемента, который встанет на позицию k; id не меняются.
+    // Переставляются только указатели: сами NPC остаются по прежним адресам в куче.
+    void permute(const std::vector<size_t> &order);
+    // Растёт при каждом изменении плотных индексов существующих элементов (erase, permute).
+    std::uint64_t layout_version() const noexcept { return version; }
+
+    value_type get(NpcId id) const;
+    bool contains(NpcId id) const;
+    bool contains(const value_type &npc) const;
+    size_t count(const value_type &npc) const { return contains(npc) ? 1 : 0; }
+    NpcId id_of(const value_type &npc) const;
+    NpcId id_at(size_t dense_index) const;
+    size_t dense_index(NpcId id) const;
+
+    const value_type &operator[](size_t dense_index) const { return items[dense_index]; }
+    size_t size() const noexcept { return items.size(); }
+    bool empty() const noexcept { return items.empty(); }
+    const_iterator begin() const noexcept { return items.begin(); }
+    const_iterator end() const noexcept { return items.end(); }
+
+private:
+    struct Slot
+    {
+        std::uint32_t dense{NpcId::invalid_index}; // для свободного слота — следующий свободный
+        std::uint32_t generation{0};
+        bool used{false};
+    };
+
+    std::vector<value_type> items;
+    std::vector<std::uint32_t> slot_of_dense;
+    std::vector<Slot> slots;
+    std::uint32_t free_head{NpcId::invalid_index};
+    std::uint64_t version{0};
+    std::unordered_map<const NPC *, std::uint32_t> by_pointer;
+};
+
+// Совместимость со старым кодом, где set_t был std::set<std::shared_ptr<NPC>>.
+using set_t = NpcStore;
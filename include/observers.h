@@ -1,11 +1,19 @@
 #pragma once
 
 #include "npc.h"
+#include "rules.h"
 
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
 #include <fstream>
+#include <iostream>
 #include <memory>
 #include <mutex>
 #include <string>
+#include <thread>
+#include <vector>
 
 class ConsoleObserver : public IFightObserver
 {
@@ -13,6 +21,7 @@ public:
     void on_fight(const std::shared_ptr<NPC> attacker,
                   const std::shared_ptr<NPC> defender,
                   bool win) override;
+    void on_fights(const NpcStore &npcs, std::span<const FightOutcome> outcomes) override;
 };
 
 class FileObserver : public IFightObserver
@@ -22,8 +31,52 @@ public:
     void on_fight(const std::shared_ptr<NPC> attacker,
                   const std::shared_ptr<NPC> defender,
                   bool win) override;
+    void on_fights(const NpcStore &npcs, std::span<const FightOutcome> outcomes) override;
 
 private:
     std::ofstream out;
     std::mutex mtx;
 };
+
+struct ConsoleSummaryOptions
+{
+    std::chrono::milliseconds interval{1000};
+    size_t samples_per_interval{3};
+    std::ostream *out{&std::cout};
+};
+
+// Копит убийства за интервал (счётчики по типам + несколько примеров) и печатает сводку
+// из собственного потока. on_fight держит только свой короткий mutex, не console_mutex().
+class SummaryConsoleObserver : public IFightObserver
+{
+public:
+    explicit SummaryConsoleObserver(ConsoleSummaryOptions options = {});
+    ~SummaryConsoleObserver() override;
+
+    void on_fight(const std::shared_ptr<NPC> attacker,
+                  const std::shared_ptr<NPC> defender,
+                  bool win) override;
+    void on_fights(const NpcStore &npcs, std::span<const FightOutcome> outcomes) override;
+
+    // Немедленно печатает накопленное (используется при остановке и в тестах).
+    void flush();
+
+private:
+    struct Interval
+    {
+        std::array<std::array<size_t, NPC_TYPE_COUNT>, NPC_TYPE_COUNT> kills{};
+        size_t total{0};
+        std::vector<std::string> samples;
+    };
+
+    void record(const NPC &attacker, const NPC &defender);
+    void print(const Interval &interval) const;
+    void printer_loop();
+
+    ConsoleSummaryOptions options;
+    Interval pending;
+    std::mutex mtx;
+    std::condition_variable cv;
+    bool stopped{false};
+    std::thread printer;
+};
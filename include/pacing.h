@@ -0,0 +1,55 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+struct TickStats
+{
+    std::chrono::microseconds p50{0};
+    std::chrono::microseconds p99{0};
+    std::chrono::microseconds max{0};
+    size_t ticks{0};
+    size_t overruns{0};
+    size_t detection_slices{1};
+};
+
+// Темп тиков с бюджетом: тик длится period от начала до начала (sleep_until, без дрейфа).
+// Если фаза поиска пар не укладывается в свою долю бюджета, она размазывается на
+// несколько тиков: каждый тик обрабатывает следующий кусок из detection_slices().
+class TickPacer
+{
+public:
+    using clock = std::chrono::steady_clock;
+
+    explicit TickPacer(clock::duration period, double detection_share = 0.5, size_t max_slices = 16);
+
+    void begin_tick();
+    // Кусок [begin, end) из total элементов, который нужно проверить в этом тике.
+    std::pair<size_t, size_t> detection_slice(size_t total);
+    void end_detection();
+    // Закрывает тик и ждёт до начала следующего.
+    void end_tick();
+    // Закрывает тик без ожидания (для тестов и пакетных прогонов).
+    void finish_tick();
+
+    size_t detection_slices() const noexcept { return slices; }
+    TickStats stats() const;
+
+private:
+    clock::duration period;
+    clock::duration detection_budget;
+    size_t max_slices;
+    size_t slices{1};
+    size_t cursor{0};
+    clock::time_point tick_start;
+    clock::time_point detection_start;
+    clock::time_point deadline;
+    bool started{false};
+
+    std::vector<clock::duration> history; // кольцо последних длительностей тиков
+    size_t history_next{0};
+    size_t ticks{0};
+    size_t overruns{0};
+};
@@ -0,0 +1,109 @@
+#pragma once
+
+#include "npc.h"
+#include "npc_store.h"
+#include "placement.h"
+#include "resolver.h"
+#include "rules.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Горячее состояние NPC в 8 байтах: то, что читают циклы симуляции каждый тик.
+struct NpcHot
+{
+    static constexpr std::uint8_t ALIVE_BIT = 0x80;
+    static constexpr std::uint8_t TYPE_MASK = 0x7F;
+
+    std::int16_t x;
+    std::int16_t y;
+    std::uint8_t meta;     // тип в младших битах, ALIVE_BIT — жив
+    std::uint8_t reserved; // выравнивание до 4 int16-полос, всегда 0
+    std::uint16_t generation;
+
+    NpcType type() const noexcept { return static_cast<NpcType>(meta & TYPE_MASK); }
+    bool alive() const noexcept { return (meta & ALIVE_BIT) != 0; }
+};
+
+static_assert(sizeof(NpcHot) == 8, "NpcHot must stay 8 bytes");
+
+// Мир в упакованном виде: плотный массив NpcHot + имена в одном общем буфере.
+// Координаты должны помещаться в int16 (карта до 32767 по каждой оси), имена — в
+// MAX_NAME байт: у каждой записи хранится только длина имени (1 байт), а смещение в
+// буфере — одно на NAME_BLOCK записей.
+class PackedWorld
+{
+public:
+    static constexpr int MIN_COORD = INT16_MIN;
+    static constexpr int MAX_COORD = INT16_MAX;
+    static constexpr size_t MAX_NAME = UINT8_MAX;
+    static constexpr size_t NAME_BLOCK = 32;
+
+    PackedWorld() = default;
+    explicit PackedWorld(const WorldMemoryOptions &options);
+
+    // Добавляет запись в конец (индекс size() - 1). Координаты вне [MIN_COORD, MAX_COORD]
+    // и имена длиннее MAX_NAME не усекаются: add() возвращает false и мир не меняется.
+    bool add(NpcType type, std::string_view name, int x, int y, std::uint16_t generation = 0);
+    void reserve(size_t count, size_t name_bytes = 0);
+    // Очищает мир, сохраняя выделенную память для следующего заполнения.
+    void clear();
+
+    size_t size() const noexcept { return hot.size(); }
+    std::span<NpcHot> records() noexcept { return hot; }
+    std::span<const NpcHot> records() const noexcept { return hot; }
+    std::string_view name(std::uint32_t index) const;
+    void kill(std::uint32_t index) { hot[index].meta &= NpcHot::TYPE_MASK; }
+    size_t memory_bytes() const noexcept;
+
+    // Снимок из NpcStore в его плотном порядке; generation — младшие 16 бит поколения слота.
+    // Если какой-то NPC не проходит add() (координаты вне int16, длинное имя), пишет его
+    // в std::cerr и возвращает std::nullopt.
+    static std::optional<PackedWorld> from_store(const set_t &npcs);
+    // То же с заданным размещением; при options.first_touch записи раскладываются по узлам через pool.
+    static std::optional<PackedWorld> from_store(const set_t &npcs, const WorldMemoryOptions &options, ThreadPool &pool);
+    // Возвращает позиции и смерти объектам NpcStore (тот же плотный порядок, что при from_store).
+    void apply_to(const set_t &npcs) const;
+
+    // Переносит записи в новый буфер, страницы которого впервые пишут потоки
+    // на узлах своих участков (см. WorldMemoryOptions).
+    void place(ThreadPool &pool, const NumaTopology &topology = NumaTopology::system());
+    const WorldMemoryOptions &memory_options() const noexcept { return options; }
+
+private:
+    WorldMemoryOptions options;
+    placed_vector<NpcHot> hot;
+    std::vector<std::uint8_t> name_lengths;
+    std::vector<std::uint32_t> name_blocks; // смещение имени записи i * NAME_BLOCK
+    std::string names;
+};
+
+// Рабочие буферы fight_packed; при повторных вызовах память переиспользуется.
+struct PackedFightScratch
+{
+    struct Entry
+    {
+        int x;
+        std::uint32_t index;
+    };
+
+    PackedFightScratch() = default;
+    explicit PackedFightScratch(HugePages huge_pages);
+
+    std::array<placed_vector<Entry>, NPC_TYPE_COUNT> buckets;
+    placed_vector<FightCandidate> candidates;
+    placed_vector<std::uint8_t> attack;
+    placed_vector<std::uint8_t> defense;
+};
+
+// Аналог fight() по упакованному миру: те же кандидаты в том же порядке, те же броски
+// для того же seed. Проигравшие помечаются мёртвыми; исходы пишутся в out.
+void fight_packed(PackedWorld &world, size_t distance, std::uint64_t seed, std::vector<FightOutcome> &out);
+void fight_packed(PackedWorld &world, size_t distance, std::uint64_t seed, std::vector<FightOutcome> &out,
+                  PackedFightScratch &scratch);
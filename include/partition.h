@@ -0,0 +1,85 @@
+#pragma once
+
+#include "npc_store.h"
+#include "resolver.h"
+#include "spatial.h"
+#include "thread_pool.h"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+struct Tile
+{
+    int x0; // [x0, x1) x [y0, y1)
+    int y0;
+    int x1;
+    int y1;
+};
+
+// Адаптивное k-d разбиение мира на плитки для раздачи работы потокам. Границы делят
+// не число NPC, а замеренную стоимость: вес NPC — среднее время на NPC его плитки за
+// последнее окно. Перестройка идёт раз в rebalance_every тиков; до первых замеров
+// все веса равны, т.е. плитки делят NPC поровну.
+class AdaptivePartitioner
+{
+public:
+    explicit AdaptivePartitioner(size_t tiles, size_t rebalance_every = 8);
+
+    // Раскладывает живых NPC по текущим плиткам; при первом вызове строит плитки.
+    void assign(const set_t &npcs);
+    size_t tile_count() const noexcept { return leaves.size(); }
+    const std::vector<Tile> &tiles() const noexcept { return leaves; }
+    std::span<const std::uint32_t> members(size_t tile) const;
+
+    // Время обработки плитки в этом тике (можно звать из разных потоков для разных плиток).
+    void record(size_t tile, std::chrono::nanoseconds cost);
+    // Закрывает тик; возвращает true, если границы были перестроены.
+    bool end_tick(const set_t &npcs);
+
+    // max / среднее замеренной стоимости плиток за последнее закрытое окно (1 — идеально).
+    double imbalance() const noexcept { return last_imbalance; }
+    size_t rebalances() const noexcept { return rebalance_count; }
+
+private:
+    struct Split
+    {
+        bool vertical; // делит по x
+        int value;     // слева < value, справа >= value
+        std::int32_t left;
+        std::int32_t right; // < 0: лист ~tile
+    };
+
+    struct Point
+    {
+        int x;
+        int y;
+        double weight;
+    };
+
+    void build(const set_t &npcs, const std::vector<double> &weights);
+    std::int32_t build_node(std::vector<Point> &points, size_t begin, size_t end, size_t tiles, Tile bounds);
+    size_t locate(int x, int y) const;
+
+    size_t target_tiles;
+    size_t rebalance_every;
+    size_t tick{0};
+    size_t rebalance_count{0};
+    double last_imbalance{1.0};
+
+    std::vector<Split> splits;
+    std::int32_t root{-1};
+    std::vector<Tile> leaves;
+    std::vector<std::uint32_t> offsets; // члены плитки t: order[offsets[t] .. offsets[t + 1])
+    std::vector<std::uint32_t> order;
+    std::vector<std::uint32_t> tile_of; // по плотному индексу, для весов при перестройке
+    std::vector<std::chrono::nanoseconds::rep> window; // накопленное время плиток за окно
+};
+
+// Поиск пар хищник/жертва (радиус kill_distance хищника) по плиткам на пуле, с замером
+// времени каждой плитки. Результат упорядочен по (attacker, defender) и от разбиения
+// не зависит. index должен быть построен по текущим позициям npcs.
+void collect_candidates_tiled(const set_t &npcs, const SpatialIndex &index, AdaptivePartitioner &partition,
+                              ThreadPool &pool, std::vector<FightCandidate> &out);
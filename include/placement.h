@@ -0,0 +1,123 @@
+#pragma once
+
+#include "thread_pool.h"
+
+#include <cstddef>
+#include <new>
+#include <sched.h>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Huge-страницы для больших буферов мира.
+enum class HugePages
+{
+    Off,         // обычные страницы
+    Transparent, // madvise(MADV_HUGEPAGE), ядро собирает huge-страницы само
+    Explicit,    // MAP_HUGETLB из пула hugetlbfs; если пул пуст — как Transparent
+};
+
+// Параметры размещения памяти мира. Разбиение на участки то же, что у parallel_for:
+// участок i из n принадлежит узлу i * nodes / n.
+struct WorldMemoryOptions
+{
+    HugePages huge_pages{HugePages::Off};
+    bool first_touch{false}; // страницы участка впервые пишет поток, привязанный к его узлу
+    bool pin_threads{false}; // проходы по участку идут на CPU его узла
+};
+
+// Узлы NUMA и их CPU из /sys/devices/system/node. Если sysfs недоступен — один узел со всеми CPU.
+class NumaTopology
+{
+public:
+    explicit NumaTopology(std::vector<std::vector<unsigned>> node_cpus);
+
+    static const NumaTopology &system();
+
+    size_t nodes() const noexcept { return node_cpus.size(); }
+    bool multi_node() const noexcept { return node_cpus.size() > 1; }
+    const std::vector<unsigned> &cpus(size_t node) const { return node_cpus[node]; }
+    // Узел, которому принадлежит элемент index из count.
+    size_t node_of(size_t index, size_t count) const noexcept;
+
+private:
+    std::vector<std::vector<unsigned>> node_cpus;
+};
+
+// Привязывает текущий поток к CPU узла, в деструкторе возвращает прежнюю маску.
+// На однозональной топологии ничего не делает.
+class NodeBinding
+{
+public:
+    NodeBinding(const NumaTopology &topology, size_t node);
+    ~NodeBinding();
+
+    NodeBinding(const NodeBinding &) = delete;
+    NodeBinding &operator=(const NodeBinding &) = delete;
+
+    bool bound() const noexcept { return restore; }
+
+private:
+    cpu_set_t previous;
+    bool restore{false};
+};
+
+// Выделение под буферы мира: при huge_pages != Off крупные блоки берутся через mmap
+// (выровнены на 2 МБ), мелкие и все при Off — через operator new.
+void *placed_allocate(size_t bytes, HugePages mode);
+void placed_free(void *data, size_t bytes, HugePages mode) noexcept;
+
+// Аллокатор для буферов мира. construct() без аргументов не инициализирует
+// тривиальные типы, поэтому resize() не касается страниц: первым их пишет владелец участка.
+template <class T>
+class PlacedAllocator
+{
+public:
+    using value_type = T;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+
+    PlacedAllocator() noexcept = default;
+    explicit PlacedAllocator(HugePages mode) noexcept : mode(mode) {}
+    template <class U>
+    PlacedAllocator(const PlacedAllocator<U> &other) noexcept : mode(other.huge_pages()) {}
+
+    T *allocate(size_t count) { return static_cast<T *>(placed_allocate(count * sizeof(T), mode)); }
+    void deallocate(T *data, size_t count) noexcept { placed_free(data, count * sizeof(T), mode); }
+
+    template <class U, class... Args>
+    void construct(U *p, Args &&...args)
+    {
+        if constexpr (sizeof...(Args) == 0)
+            ::new (static_cast<void *>(p)) U;
+        else
+            ::new (static_cast<void *>(p)) U(std::forward<Args>(args)...);
+    }
+
+    HugePages huge_pages() const noexcept { return mode; }
+
+    template <class U>
+    bool operator==(const PlacedAllocator<U> &other) const noexcept { return mode == other.huge_pages(); }
+
+private:
+    HugePages mode{HugePages::Off};
+};
+
+template <class T>
+using placed_vector = std::vector<T, PlacedAllocator<T>>;
+
+// parallel_for, в котором кусок [begin, end) выполняется на CPU узла, владеющего begin.
+// При bind == false или одном узле — обычный parallel_for.
+template <class F>
+void parallel_for_on_nodes(ThreadPool &pool, size_t count, const NumaTopology &topology, bool bind, F &&body)
+{
+    if (!bind || !topology.multi_node())
+    {
+        pool.parallel_for(count, body);
+        return;
+    }
+    pool.parallel_for(count, [&](size_t begin, size_t end)
+                      {
+        NodeBinding binding(topology, topology.node_of(begin, count));
+        body(begin, end); });
+}
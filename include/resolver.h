@@ -0,0 +1,87 @@
+#pragma once
+
+#include "npc.h"
+#include "npc_store.h"
+#include "timer_wheel.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+struct FightCandidate
+{
+    std::uint32_t attacker; // плотные индексы в NpcStore
+    std::uint32_t defender;
+};
+
+// Пакетное разрешение боёв: все броски кубиков генерируются одним проходом из seed
+// (счётчиковый генератор, без зависимостей между итерациями), затем один проход по
+// кандидатам в порядке списка применяет исходы к плоскому массиву флагов «мёртв».
+// Кандидаты должны быть собраны из живых NPC по таблице can_attack; смерти, которые
+// вызвал сам резолвер, помнятся между пакетами, пока не поменялась раскладка NpcStore.
+// Броски и проход по флагам дешёвые; основное время уходит на NPC::die() — по промаху
+// кэша и блокировке на каждую смерть, поэтому выигрыш против поштучного разрешения
+// невелик: на 100k кандидатах (-O2) 12 мс поштучно против 9.5 мс пакетом, ~1.25x.
+// Для всего fight() это почти незаметно: на мире из 100k NPC раунд занимает 170-260 мс,
+// и почти всё это — поиск пар по объектам NPC. fight_packed на том же мире — ~24 мс.
+class FightResolver
+{
+public:
+    // Убивает проигравших через NPC::die(); кандидаты с уже мёртвой стороной пропускаются.
+    void resolve(const NpcStore &npcs, std::span<const FightCandidate> candidates, std::uint64_t seed);
+    std::span<const FightOutcome> outcomes() const noexcept { return results; }
+    // Отдаёт исходы наблюдателям атакующих одним span на наблюдателя.
+    void notify(const NpcStore &npcs) const;
+    // Сбрасывает запомненные смерти; resolve() делает это сам при смене layout_version().
+    void reset();
+
+private:
+    std::vector<std::uint8_t> attack;
+    std::vector<std::uint8_t> defense;
+    std::vector<std::uint8_t> dead;
+    std::uint64_t layout{0};
+    std::vector<FightOutcome> results;
+};
+
+// Перезарядка атак на колесе таймеров: победивший атакующий не нападает ticks тиков.
+// Таймер несёт слот и поколение NpcId, флаг перезарядки лежит в массиве по слоту,
+// поэтому перестановки NpcStore его не сбивают. Не потокобезопасно: всё — в потоке боёв.
+class AttackCooldowns
+{
+public:
+    explicit AttackCooldowns(std::uint64_t ticks) : ticks(ticks) {}
+
+    // Двигает часы до now; истёкшие перезарядки снимаются.
+    void advance_to(std::uint64_t now);
+    bool resting(NpcId id) const noexcept;
+    // Выкидывает пары, где атакующий на перезарядке.
+    void filter(const NpcStore &npcs, std::vector<FightCandidate> &candidates) const;
+    // Ставит перезарядку победителям из outcomes.
+    void start(const NpcStore &npcs, std::span<const FightOutcome> outcomes);
+    size_t active() const noexcept { return wheel.size(); }
+
+private:
+    struct Rest
+    {
+        std::uint32_t generation{0};
+        bool on{false};
+    };
+
+    std::uint64_t ticks;
+    TimerWheel wheel;
+    std::vector<Rest> rest; // по NpcId::index
+};
+
+// Счётчиковый генератор (splitmix64): 64 случайных бита, зависящих только от seed и counter,
+// поэтому циклы по counter не имеют зависимостей между итерациями и делятся между потоками.
+inline std::uint64_t counter_bits(std::uint64_t seed, std::uint64_t counter)
+{
+    std::uint64_t z = seed + (counter + 1) * 0x9E3779B97F4A7C15ull;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+// Заполняет attack[i]/defense[i] бросками d6; значения зависят только от seed и i.
+void roll_dice_batch(std::uint64_t seed, std::span<std::uint8_t> attack, std::span<std::uint8_t> defense);
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "npc.h"
+
+#include <cstddef>
+
+constexpr size_t NPC_TYPE_COUNT = 4;
+
+struct MoveRule
+{
+    int step;
+    int kill_distance;
+};
+
+MoveRule rules_for(NpcType type);
+
+// Таблица «кто кого может убить»; должна совпадать с перегрузками NPC::fight.
+bool can_attack(NpcType attacker, NpcType defender);
+bool has_prey(NpcType attacker);
@@ -0,0 +1,134 @@
+#pragma once
+
+#include "npc.h"
+#include "npc_store.h"
+#include "rules.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// Неизменяемый снимок мира для внешних наблюдателей. Поток симуляции копирует только
+// POD-состояние NPC (тип, координаты, живость) и строки убийств; текст ответов собирает
+// при первом запросе поток сервера, дальше все клиенты получают эти же строки.
+struct WorldSnapshot
+{
+    struct Entry
+    {
+        int x;
+        int y;
+        NpcType type;
+        bool alive;
+    };
+
+    std::uint64_t version{0};
+    std::uint64_t layout{0};
+    std::vector<Entry> entries; // по плотным индексам NpcStore
+    // Имена по тем же индексам; общие для снимков одной раскладки.
+    std::shared_ptr<const std::vector<std::string>> names;
+    std::vector<std::string> recent_kills;
+
+    // previous — прошлый снимок: его таблица имён переиспользуется, если раскладка не менялась.
+    static std::shared_ptr<const WorldSnapshot> capture(const set_t &npcs, std::uint64_t version,
+                                                        std::vector<std::string> recent_kills,
+                                                        const std::shared_ptr<const WorldSnapshot> &previous = nullptr);
+
+    const std::string &version_text() const; // "<version>\n"
+    const std::string &counts() const;       // "Ork 12\n..."
+    const std::string &positions() const;    // "Ork name x y\n" по живым NPC
+    const std::string &kills() const;        // последние убийства, по строке на убийство
+
+private:
+    struct Text
+    {
+        std::string version;
+        std::string counts;
+        std::string positions;
+        std::string kills;
+    };
+
+    const Text &text() const;
+
+    mutable std::once_flag rendered;
+    mutable Text rendered_text;
+};
+
+// Кольцо последних убийств для снимков: "Ork a {x, y} -> Druid b {x, y}".
+class RecentKillsObserver : public IFightObserver
+{
+public:
+    explicit RecentKillsObserver(size_t capacity = 32) : capacity(capacity) {}
+
+    void on_fight(const std::shared_ptr<NPC> attacker,
+                  const std::shared_ptr<NPC> defender,
+                  bool win) override;
+    void on_fights(const NpcStore &npcs, std::span<const FightOutcome> outcomes) override;
+
+    // От старых к новым.
+    std::vector<std::string> recent() const;
+
+private:
+    void record(const NPC &attacker, const NPC &defender);
+
+    size_t capacity;
+    std::deque<std::string> kills;
+    mutable std::mutex mtx;
+};
+
+// Сервер снимков на Unix-сокете. Протокол построчный: клиент шлёт VERSION, COUNTS,
+// POSITIONS или KILLS, сервер отвечает "OK <version> <bytes>\n" и телом из текущего
+// снимка (или "ERR <причина>\n"). Симуляция только подменяет указатель в publish();
+// клиенты обслуживаются отдельным потоком через poll и NPC не трогают. Медленный
+// клиент держит ссылку на свой снимок, пока не дочитает ответ. Клиент, закрывший
+// запись (shutdown SHUT_WR), получает ответы на все уже присланные запросы.
+class SnapshotServer
+{
+public:
+    explicit SnapshotServer(std::string socket_path);
+    ~SnapshotServer();
+
+    SnapshotServer(const SnapshotServer &) = delete;
+    SnapshotServer &operator=(const SnapshotServer &) = delete;
+
+    // Создаёт сокет и запускает поток; false (с сообщением в std::cerr) при ошибке.
+    // Оставшийся от прошлого запуска сокет по socket_path заменяется; любой другой файл
+    // там — ошибка, и он не трогается.
+    bool start();
+    void stop();
+
+    void publish(std::shared_ptr<const WorldSnapshot> snapshot);
+    std::shared_ptr<const WorldSnapshot> current() const;
+
+    const std::string &path() const noexcept { return socket_path; }
+    // Число обработанных запросов (включая ответы ERR).
+    size_t served() const noexcept { return responses.load(std::memory_order_relaxed); }
+
+private:
+    struct Client;
+
+    void loop();
+    // false — соединение оборвано; конец ввода (клиент закрыл запись) отмечается в Client.
+    bool handle_input(Client &client);
+    bool answer_requests(Client &client);
+    bool flush_output(Client &client);
+
+    std::string socket_path;
+    std::atomic<std::shared_ptr<const WorldSnapshot>> snapshot;
+    std::atomic<size_t> responses{0};
+    int listen_fd{-1};
+    bool bound{false}; // socket_path создан нами, stop() его удаляет
+    int wake_fds[2]{-1, -1};
+    std::thread worker;
+};
+
+// Простой синхронный клиент (для тестов и утилит): тело ответа или пустая строка с
+// текстом ошибки в error.
+std::string query_snapshot(const std::string &socket_path, std::string_view command, std::string *error = nullptr);
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "npc.h"
+#include "npc_store.h"
+#include "thread_pool.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+using TypeMask = std::uint8_t;
+
+constexpr TypeMask type_mask(NpcType type) { return static_cast<TypeMask>(1u << type); }
+constexpr TypeMask ANY_TYPE = 0xFF;
+
+TypeMask prey_mask(NpcType attacker);
+TypeMask predator_mask(NpcType defender);
+
+struct SpatialHit
+{
+    size_t index; // плотный индекс в set_t, по которому строился индекс
+    long long distance2;
+};
+
+// Неявное k-d дерево по живым NPC. Каждый узел хранит маску типов своего поддерева,
+// так что запросы с фильтром по типу отсекают ветки без подходящих NPC.
+class SpatialIndex
+{
+public:
+    static constexpr size_t NO_INDEX = static_cast<size_t>(-1);
+
+    void rebuild(const set_t &npcs, ThreadPool *pool = nullptr);
+    size_t size() const noexcept { return nodes.size(); }
+
+    std::optional<SpatialHit> nearest(int x, int y, TypeMask mask, size_t exclude = NO_INDEX) const;
+    // Результаты упорядочены по (distance2, index).
+    void k_nearest(int x, int y, size_t k, TypeMask mask, std::vector<SpatialHit> &out,
+                   size_t exclude = NO_INDEX) const;
+    void within_radius(int x, int y, size_t radius, TypeMask mask, std::vector<SpatialHit> &out,
+                       size_t exclude = NO_INDEX) const;
+
+private:
+    struct Node
+    {
+        int x;
+        int y;
+        std::uint32_t index;
+        TypeMask type;
+        TypeMask subtree;
+    };
+
+    struct Query;
+
+    TypeMask build(size_t begin, size_t end, size_t depth);
+    void split_top(size_t begin, size_t end, size_t depth, size_t levels, std::vector<size_t> &jobs);
+    TypeMask finish_top(size_t begin, size_t end, size_t levels);
+    void search_k(size_t begin, size_t end, size_t depth, Query &query) const;
+    void search_radius(size_t begin, size_t end, size_t depth, Query &query) const;
+
+    std::vector<Node> nodes;
+};
@@ -0,0 +1,157 @@
+#pragma once
+
+#include "format.h"
+#include "npc.h"
+#include "npc_store.h"
+
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <span>
+#include <string>
+#include <tuple>
+#include <utility>
+
+// Какие исходы нужны наблюдателю; проверка выбирается при компиляции.
+enum class FightFilter
+{
+    All,
+    Wins,
+    Losses,
+};
+
+// Событие статического конвейера: ссылки и плотные индексы вместо копий shared_ptr.
+struct FightEvent
+{
+    const NPC &attacker;
+    const NPC &defender;
+    std::uint32_t attacker_index;
+    std::uint32_t defender_index;
+    bool win;
+};
+
+// Наблюдатель конвейера: static constexpr FightFilter filter и on_fight(const FightEvent &).
+// Необязательный end_batch() вызывается после каждого пакета исходов.
+template <class T>
+concept StaticFightObserver = requires(T &observer, const FightEvent &event) {
+    { T::filter } -> std::convertible_to<FightFilter>;
+    observer.on_fight(event);
+};
+
+// Набор наблюдателей, собранный при компиляции: Observers<ConsoleKills, FileKills>.
+// Observers<> ничего не делает, и notify() для него компилируется в пустую функцию.
+template <StaticFightObserver... Obs>
+class Observers
+{
+public:
+    static constexpr bool empty = sizeof...(Obs) == 0;
+
+    Observers() = default;
+    explicit Observers(Obs... observers)
+        requires(sizeof...(Obs) > 0)
+        : items(std::move(observers)...) {}
+
+    void notify(const NpcStore &npcs, std::span<const FightOutcome> outcomes)
+    {
+        if constexpr (!empty)
+            std::apply([&](auto &...observer)
+                       { (deliver(observer, npcs, outcomes), ...); },
+                       items);
+    }
+
+    template <class T>
+    T &get() noexcept { return std::get<T>(items); }
+
+private:
+    template <class T>
+    static void deliver(T &observer, const NpcStore &npcs, std::span<const FightOutcome> outcomes)
+    {
+        for (const auto &outcome : outcomes)
+        {
+            if constexpr (T::filter == FightFilter::Wins)
+            {
+                if (!outcome.win)
+                    continue;
+            }
+            else if constexpr (T::filter == FightFilter::Losses)
+            {
+                if (outcome.win)
+                    continue;
+            }
+            observer.on_fight(FightEvent{*npcs[outcome.attacker], *npcs[outcome.defender],
+                                         outcome.attacker, outcome.defender, outcome.win});
+        }
+        if constexpr (requires { observer.end_batch(); })
+            observer.end_batch();
+    }
+
+    std::tuple<Obs...> items;
+};
+
+// Статические аналоги ConsoleObserver/FileObserver: тот же текст, один write на пакет.
+class ConsoleKills
+{
+public:
+    static constexpr FightFilter filter = FightFilter::Wins;
+
+    void on_fight(const FightEvent &event)
+    {
+        buffer.append("\nMurder --------\n");
+        append_npc_line(buffer, event.attacker);
+        append_npc_line(buffer, event.defender);
+    }
+
+    void end_batch()
+    {
+        if (buffer.empty())
+            return;
+        std::lock_guard<std::mutex> lck(console_mutex());
+        flush_buffer(std::cout, buffer);
+    }
+
+private:
+    std::string buffer;
+};
+
+class FileKills
+{
+public:
+    static constexpr FightFilter filter = FightFilter::Wins;
+
+    explicit FileKills(const std::string &path) : out(path, std::ios::trunc) {}
+
+    void on_fight(const FightEvent &event)
+    {
+        buffer.append("Kill: ");
+        append_npc(buffer, event.attacker);
+        buffer.append(" -> ");
+        append_npc(buffer, event.defender);
+        buffer.push_back('\n');
+    }
+
+    void end_batch()
+    {
+        if (buffer.empty() || !out)
+            return;
+        flush_buffer(out, buffer);
+        out.flush();
+    }
+
+private:
+    std::ofstream out;
+    std::string buffer;
+};
+
+// Счётчик исходов (для безголовых прогонов и тестов).
+template <FightFilter Filter = FightFilter::All>
+struct FightCounter
+{
+    static constexpr FightFilter filter = Filter;
+
+    size_t events{0};
+
+    void on_fight(const FightEvent &) noexcept { ++events; }
+};
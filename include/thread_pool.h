@@ -0,0 +1,90 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Пул потоков фиксированного размера. parallel_for блокирует вызывающего,
+// поэтому его нельзя звать изнутри задач этого же пула.
+class ThreadPool
+{
+public:
+    explicit ThreadPool(size_t threads = std::max<size_t>(1, std::thread::hardware_concurrency()));
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    size_t size() const noexcept { return workers.size(); }
+
+    template <class F>
+    std::future<void> submit(F &&task)
+    {
+        auto packaged = std::make_shared<std::packaged_task<void()>>(std::forward<F>(task));
+        auto result = packaged->get_future();
+        enqueue([packaged]()
+                { (*packaged)(); });
+        return result;
+    }
+
+    // Делит [0, count) на непрерывные куски и вызывает body(begin, end) для каждого.
+    // Если кусок бросает, ждёт остальные и пробрасывает первое исключение.
+    template <class F>
+    void parallel_for(size_t count, F &&body)
+    {
+        if (count == 0)
+            return;
+        const size_t chunks = std::min(count, size() + 1);
+        const size_t chunk = (count + chunks - 1) / chunks;
+        std::vector<std::future<void>> pending;
+        pending.reserve(chunks);
+        for (size_t begin = chunk; begin < count; begin += chunk)
+        {
+            const size_t end = std::min(count, begin + chunk);
+            pending.push_back(submit([&body, begin, end]()
+                                     { body(begin, end); }));
+        }
+        std::exception_ptr failure;
+        try
+        {
+            body(size_t{0}, std::min(count, chunk));
+        }
+        catch (...)
+        {
+            failure = std::current_exception();
+        }
+        // Задачи держат ссылки на body и локальные данные вызывающего: дожидаемся всех.
+        for (auto &f : pending)
+        {
+            try
+            {
+                f.get();
+            }
+            catch (...)
+            {
+                if (!failure)
+                    failure = std::current_exception();
+            }
+        }
+        if (failure)
+            std::rethrow_exception(failure);
+    }
+
+private:
+    void enqueue(std::function<void()> task);
+    void worker_loop();
+
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> tasks;
+    std::mutex mtx;
+    std::condition_variable cv;
+    bool stopped{false};
+};
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+struct TimerId
+{
+    std::uint32_t index{std::numeric_limits<std::uint32_t>::max()};
+    std::uint32_t generation{0};
+
+    bool valid() const noexcept { return index != std::numeric_limits<std::uint32_t>::max(); }
+    friend bool operator==(const TimerId &, const TimerId &) = default;
+};
+
+// Иерархическое колесо таймеров: 4 уровня по 256 слотов, время — в тиках (единицу
+// выбирает владелец, например 1 мс). schedule и cancel — O(1): узел из пула вставляется
+// в список слота или вынимается из него, без аллокаций после reserve(). Таймер несёт
+// только 64-битный payload (событие, id NPC и т.п.), обработчик передаётся в advance().
+// Задержки больше 2^32 тиков ждут на верхнем уровне и переставляются при каскаде.
+// Не потокобезопасно: колесо двигает один поток.
+class TimerWheel
+{
+public:
+    static constexpr unsigned LEVEL_BITS = 8;
+    static constexpr unsigned LEVELS = 4;
+    static constexpr std::uint64_t SLOTS = 1u << LEVEL_BITS;
+
+    void reserve(size_t timers);
+
+    TimerId schedule(std::uint64_t delay, std::uint64_t payload);
+    // false, если таймер уже сработал или отменён.
+    bool cancel(TimerId id);
+    bool pending(TimerId id) const noexcept;
+
+    std::uint64_t now() const noexcept { return current; }
+    size_t size() const noexcept { return active; }
+
+    // Тиков до ближайшего таймера нижнего уровня, не больше limit (limit, если ближе ничего
+    // нет). Таймеры верхних уровней не раньше следующего каскада, так что это нижняя оценка.
+    std::uint64_t ticks_until_next(std::uint64_t limit) const noexcept;
+
+    // Двигает время до target, вызывая on_fire(TimerId, payload) для каждого сработавшего
+    // таймера в порядке срабатывания. Из on_fire можно ставить и отменять таймеры.
+    template <class F>
+    size_t advance_to(std::uint64_t target, F &&on_fire)
+    {
+        size_t fired = 0;
+        while (current < target)
+        {
+            ++current;
+            if (active == 0)
+            {
+                // Пустое колесо можно перемотать сразу.
+                current = target;
+                break;
+            }
+            collect_due();
+            for (const auto &[id, payload] : firing)
+            {
+                if (!pending(id))
+                    continue;
+                release(id.index);
+                ++fired;
+                on_fire(id, payload);
+            }
+        }
+        return fired;
+    }
+
+private:
+    static constexpr std::uint32_t NIL = std::numeric_limits<std::uint32_t>::max();
+
+    struct Node
+    {
+        std::uint64_t expires;
+        std::uint64_t payload;
+        std::uint32_t prev;
+        std::uint32_t next;
+        std::uint32_t slot; // глобальный номер слота или NIL, если узел не в колесе
+        std::uint32_t generation;
+        bool live;
+    };
+
+    void insert(std::uint32_t index);
+    void unlink(std::uint32_t index);
+    void release(std::uint32_t index);
+    // Каскад верхних уровней и снятие слота текущего тика в firing.
+    void collect_due();
+    void cascade(unsigned level);
+
+    std::vector<Node> nodes;
+    std::vector<std::uint32_t> free_nodes;
+    std::array<std::uint32_t, LEVELS * SLOTS> heads = make_heads();
+    std::vector<std::pair<TimerId, std::uint64_t>> firing;
+    std::vector<std::uint32_t> moving;
+    std::uint64_t current{0};
+    size_t active{0};
+
+    static std::array<std::uint32_t, LEVELS * SLOTS> make_heads()
+    {
+        std::array<std::uint32_t, LEVELS * SLOTS> h;
+        h.fill(NIL);
+        return h;
+    }
+};
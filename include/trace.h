@@ -0,0 +1,76 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+// Трассировка фаз симуляции: TRACE_SCOPE("name") пишет интервал в кольцевой буфер
+// своего потока (старые события затираются) без блокировок. Кольцо выделяется при первом
+// событии потока после trace_enable(). Пока трассировка выключена, стоимость span — одна
+// relaxed-загрузка флага; с -DNPC_NO_TRACE макрос исчезает совсем.
+// Имена — строковые литералы (хранится только указатель).
+
+struct TraceEvent
+{
+    const char *name;
+    std::int64_t start_ns; // от начала трассировки
+    std::int64_t duration_ns;
+};
+
+namespace trace_detail
+{
+    extern std::atomic<bool> enabled;
+    std::int64_t now_ns() noexcept;
+    void record(const char *name, std::int64_t start_ns, std::int64_t end_ns) noexcept;
+}
+
+inline bool trace_enabled() noexcept
+{
+    return trace_detail::enabled.load(std::memory_order_relaxed);
+}
+
+// Включает запись; capacity — размер кольца каждого потока (действует для ещё не выделенных колец).
+void trace_enable(size_t capacity = 1 << 16);
+void trace_disable();
+// Сбрасывает накопленные события всех потоков.
+void trace_clear();
+// Имя текущего потока в экспорте (по умолчанию "thread N").
+void trace_thread_name(const char *name);
+size_t trace_event_count();
+// Экспорт в формате Chrome trace JSON (открывается в Perfetto / chrome://tracing).
+void trace_write_chrome(std::ostream &os);
+
+class TraceScope
+{
+public:
+    explicit TraceScope(const char *name) noexcept
+        : name(name), start(trace_enabled() ? trace_detail::now_ns() : -1)
+    {
+    }
+
+    ~TraceScope()
+    {
+        if (start >= 0)
+            trace_detail::record(name, start, trace_detail::now_ns());
+    }
+
+    TraceScope(const TraceScope &) = delete;
+    TraceScope &operator=(const TraceScope &) = delete;
+
+private:
+    const char *name;
+    std::int64_t start;
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+
+#ifdef NPC_NO_TRACE
+#define TRACE_SCOPE(name) \
+    do                    \
+    {                     \
+    } while (false)
+#else
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(name)
+#endif
@@ -1,14 +1,28 @@
 #include "battle.h"
+#include "behaviour.h"
+#include "density.h"
+#include "format.h"
+#include "neighbours.h"
+#include "pacing.h"
 #include "observers.h"
+#include "resolver.h"
+#include "rules.h"
+#include "snapshot_server.h"
+#include "spatial.h"
+#include "thread_pool.h"
+#include "timer_wheel.h"
+#include "trace.h"
 
 #include <algorithm>
 #include <array>
-#include <atomic>
 #include <chrono>
 #include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
+#include <memory>
 #include <mutex>
-#include <queue>
 #include <random>
 #include <string>
 #include <thread>
@@ -25,32 +39,22 @@ namespace
     constexpr auto MOVE_TICK = 10ms;
     constexpr auto PRINT_TICK = 1s;
     constexpr auto GAME_DURATION = 30s;
+    // Запас списков соседей: сколько тиков полного шага своего типа переживает список.
+    constexpr size_t NEIGHBOUR_TICKS = 3;
+    // Победитель боя столько не нападает снова.
+    constexpr auto ATTACK_COOLDOWN = 200ms;
 
-    struct MoveRule
+    // События главного колеса таймеров (1 тик колеса = 1 мс).
+    enum GameEvent : std::uint64_t
     {
-        int step;
-        int kill_distance;
+        MoveTickEvent,
+        RenderEvent,
+        EndEvent,
     };
 
-    MoveRule rules_for(NpcType type)
+    std::uint64_t to_wheel_ticks(std::chrono::steady_clock::duration d)
     {
-        switch (type)
-        {
-        case OrkType:
-            return {20, 10};
-        case SquirrelType:
-            return {5, 5};
-        case DruidType:
-            return {10, 10};
-        default:
-            return {1, 1};
-        }
-    }
-
-    bool can_attack(NpcType attacker, NpcType defender)
-    {
-        return (attacker == OrkType && defender == DruidType) ||
-               (attacker == DruidType && defender == SquirrelType);
+        return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(d).count());
     }
 
     char marker(NpcType type)
@@ -68,33 +72,72 @@ namespace
         }
     }
 
-    struct FightEvent
+    // Сигнал «пора делать тик» от колеса таймеров к move_thread. Несколько сигналов,
+    // пришедших во время тика, сливаются в один: опоздавший тик не догоняется пачкой.
+    class TickGate
     {
-        std::shared_ptr<NPC> attacker;
-        std::shared_ptr<NPC> defender;
+    public:
+        void post()
+        {
+            std::lock_guard<std::mutex> lck(mtx);
+            ready = true;
+            cv.notify_one();
+        }
+
+        // false после stop().
+        bool wait()
+        {
+            TRACE_SCOPE("TickGate::wait");
+            std::unique_lock<std::mutex> lck(mtx);
+            cv.wait(lck, [&]()
+                    { return ready || stopped; });
+            ready = false;
+            return !stopped;
+        }
+
+        void stop()
+        {
+            std::lock_guard<std::mutex> lck(mtx);
+            stopped = true;
+            cv.notify_all();
+        }
+
+    private:
+        std::mutex mtx;
+        std::condition_variable cv;
+        bool ready{false};
+        bool stopped{false};
     };
 
     class FightQueue
     {
     public:
-        void push(FightEvent event)
+        // Индексы кандидатов действительны для раскладки layout; события от старой
+        // раскладки выбрасываются.
+        void push(std::vector<FightCandidate> &batch, std::uint64_t layout)
         {
             std::lock_guard<std::mutex> lck(mtx);
-            if (stopped)
+            if (stopped || batch.empty())
                 return;
-            events.push(std::move(event));
+            if (layout != events_layout)
+                events.clear();
+            events_layout = layout;
+            events.insert(events.end(), batch.begin(), batch.end());
             cv.notify_one();
         }
 
-        bool pop(FightEvent &event)
+        // Забирает все накопившиеся события разом.
+        bool pop_all(std::vector<FightCandidate> &batch, std::uint64_t &layout)
         {
+            TRACE_SCOPE("FightQueue::pop_all");
+            batch.clear();
             std::unique_lock<std::mutex> lck(mtx);
             cv.wait(lck, [&]()
                     { return stopped || !events.empty(); });
             if (events.empty())
                 return false;
-            event = events.front();
-            events.pop();
+            batch.swap(events);
+            layout = events_layout;
             return true;
         }
 
@@ -106,61 +149,80 @@ namespace
         }
 
     private:
-        std::queue<FightEvent> events;
+        std::vector<FightCandidate> events;
+        std::uint64_t events_layout{0};
         std::mutex mtx;
         std::condition_variable cv;
         bool stopped{false};
     };
 
-    std::pair<int, int> random_shift(NpcType type, std::mt19937 &rng)
-    {
-        const auto rule = rules_for(type);
-        std::uniform_int_distribution<int> dist(-rule.step, rule.step);
-        return {dist(rng), dist(rng)};
-    }
-
-    void print_map(const set_t &npcs)
+    // Каждая клетка карты — прямоугольный запрос к сетке плотности: O(1) на клетку
+    // вместо обхода всех NPC. В клетке показывается самый многочисленный тип.
+    void print_map(const DensityGrid &density, std::mutex &density_mutex)
     {
+        TRACE_SCOPE("print_map");
         std::array<char, GRID_SIZE * GRID_SIZE> cells{};
         cells.fill(' ');
         const int cell_w = MAP_WIDTH / GRID_SIZE;
         const int cell_h = MAP_HEIGHT / GRID_SIZE;
 
-        for (const auto &npc : npcs)
         {
-            if (!npc || !npc->is_alive())
-                continue;
-            const auto [x, y] = npc->position();
-            const int i = std::clamp(x / cell_w, 0, GRID_SIZE - 1);
-            const int j = std::clamp(y / cell_h, 0, GRID_SIZE - 1);
-            cells[j * GRID_SIZE + i] = marker(npc->get_type());
+            std::lock_guard<std::mutex> density_lock(density_mutex);
+            for (int j = 0; j < GRID_SIZE; ++j)
+            {
+                // Последний ряд и столбец забирают и координаты на самой границе карты.
+                const int y0 = j * cell_h;
+                const int y1 = j == GRID_SIZE - 1 ? MAP_HEIGHT : y0 + cell_h - 1;
+                for (int i = 0; i < GRID_SIZE; ++i)
+                {
+                    const int x0 = i * cell_w;
+                    const int x1 = i == GRID_SIZE - 1 ? MAP_WIDTH : x0 + cell_w - 1;
+                    size_t best = 0;
+                    for (auto type : {OrkType, SquirrelType, DruidType})
+                    {
+                        const size_t n = density.count(type, x0, y0, x1, y1);
+                        if (n > best)
+                        {
+                            best = n;
+                            cells[j * GRID_SIZE + i] = marker(type);
+                        }
+                    }
+                }
+            }
         }
 
-        std::lock_guard<std::mutex> lck(console_mutex());
+        std::string frame;
+        frame.reserve(GRID_SIZE * (GRID_SIZE * 3 + 1) + GRID_SIZE * 3 + 1);
         for (int j = 0; j < GRID_SIZE; ++j)
         {
             for (int i = 0; i < GRID_SIZE; ++i)
             {
-                const char c = cells[j * GRID_SIZE + i];
-                if (c == ' ')
-                    std::cout << "[ ]";
-                else
-                    std::cout << '[' << c << ']';
+                frame.push_back('[');
+                frame.push_back(cells[j * GRID_SIZE + i]);
+                frame.push_back(']');
             }
-            std::cout << '\n';
+            frame.push_back('\n');
         }
-        std::cout << std::string(GRID_SIZE * 3, '=') << '\n';
+        frame.append(GRID_SIZE * 3, '=');
+        frame.push_back('\n');
+
+        TRACE_SCOPE("console_mutex");
+        std::lock_guard<std::mutex> lck(console_mutex());
+        flush_buffer(std::cout, frame);
     }
 
     void print_survivors(const set_t &npcs)
     {
-        std::lock_guard<std::mutex> lck(console_mutex());
-        std::cout << "Survivors:\n";
+        std::string text = "Survivors:\n";
         for (const auto &npc : npcs)
         {
-            if (npc && npc->is_alive())
-                std::cout << *npc << '\n';
+            if (!npc->is_alive())
+                continue;
+            append_npc(text, *npc);
+            text.push_back('\n');
         }
+        std::lock_guard<std::mutex> lck(console_mutex());
+        flush_buffer(std::cout, text);
     }
 }
 
@@ -168,9 +230,26 @@ int main()
 {
     seed_random(static_cast<unsigned>(std::chrono::steady_clock::now().time_since_epoch().count()));
 
-    auto console_observer = std::make_shared<ConsoleObserver>();
+    // NPC_TRACE=trace.json — записать таймлайн потоков в формате Chrome trace.
+    const char *trace_path = std::getenv("NPC_TRACE");
+    if (trace_path)
+        trace_enable();
+    trace_thread_name("main");
+
+    auto console_observer = std::make_shared<SummaryConsoleObserver>();
     auto file_observer = std::make_shared<FileObserver>("log.txt");
-    std::vector<std::shared_ptr<IFightObserver>> observers{console_observer, file_observer};
+    auto kills_observer = std::make_shared<RecentKillsObserver>();
+    std::vector<std::shared_ptr<IFightObserver>> observers{console_observer, file_observer, kills_observer};
+
+    // NPC_SOCKET=path — отдавать снимки мира клиентам мониторинга через Unix-сокет.
+    const char *socket_path = std::getenv("NPC_SOCKET");
+    std::unique_ptr<SnapshotServer> snapshot_server;
+    if (socket_path)
+    {
+        snapshot_server = std::make_unique<SnapshotServer>(socket_path);
+        if (!snapshot_server->start())
+            snapshot_server.reset();
+    }
 
     set_t npcs;
     std::mt19937 seed_rng{std::random_device{}()};
@@ -188,81 +267,157 @@ int main()
     }
 
     FightQueue fight_queue;
-    std::atomic<bool> stop{false};
+    TickGate move_gate;
+    // Сетку правят шаги поведений (move_thread) и смерти (fight_thread), карту по ней
+    // рисует главный поток; все обращения — под density_mutex.
+    DensityGrid density(MAP_WIDTH, MAP_HEIGHT);
+    std::mutex density_mutex;
+    density.rebuild(npcs);
+    TickStats tick_stats;
+    size_t neighbour_rebuilds = 0;
 
     std::thread fight_thread([&]()
                              {
-        FightEvent event;
-        while (fight_queue.pop(event))
+        std::vector<FightCandidate> batch;
+        std::uint64_t layout{0};
+        FightResolver resolver;
+        // Перезарядки — таймеры по NPC на своём колесе (1 тик = 1 мс).
+        AttackCooldowns cooldowns(to_wheel_ticks(ATTACK_COOLDOWN));
+        const auto fight_start = std::chrono::steady_clock::now();
+        trace_thread_name("fight_thread");
+        while (fight_queue.pop_all(batch, layout))
         {
-            if (!event.attacker || !event.defender)
+            TRACE_SCOPE("fight_batch");
+            if (layout != npcs.layout_version())
                 continue;
-            if (!event.attacker->is_alive() || !event.defender->is_alive())
-                continue;
-            if (!can_attack(event.attacker->get_type(), event.defender->get_type()))
-                continue;
-
-            const int attack = roll_dice();
-            const int defense = roll_dice();
-            if (attack > defense)
             {
-                event.attacker->fight_notify(event.defender, true);
-                event.defender->die();
+                TRACE_SCOPE("resolve");
+                cooldowns.advance_to(to_wheel_ticks(std::chrono::steady_clock::now() - fight_start));
+                cooldowns.filter(npcs, batch);
+                resolver.resolve(npcs, batch, draw_seed());
+                cooldowns.start(npcs, resolver.outcomes());
             }
-            else
             {
-                event.attacker->fight_notify(event.defender, false);
+                TRACE_SCOPE("density.remove_killed");
+                std::lock_guard<std::mutex> density_lock(density_mutex);
+                density.remove_killed(npcs, resolver.outcomes());
             }
+            TRACE_SCOPE("notify");
+            resolver.notify(npcs);
         } });
 
     std::thread move_thread([&]()
                             {
-        std::mt19937 rng{std::random_device{}()};
-        while (!stop.load())
+        trace_thread_name("move_thread");
+        ThreadPool pool;
+        SpatialIndex index;
+        BehaviourScheduler behaviours(MAP_WIDTH, MAP_HEIGHT, std::random_device{}());
+        behaviours.context().density = &density;
+        behaviours.reserve(npcs.size());
+        for (const auto &npc : npcs)
         {
-            for (const auto &npc : npcs)
-            {
-                if (!npc || !npc->is_alive())
-                    continue;
-                const auto shift = random_shift(npc->get_type(), rng);
-                npc->move(shift.first, shift.second, MAP_WIDTH, MAP_HEIGHT);
-            }
+            if (has_prey(npc->get_type()))
+                behaviours.spawn(hunt(npc, behaviours.context(), index, npcs));
+            else
+                behaviours.spawn(wander(npc, behaviours.context()));
+        }
 
-            for (const auto &attacker : npcs)
+        std::vector<FightCandidate> candidates;
+        auto neighbours = NeighbourList::for_ticks(NEIGHBOUR_TICKS);
+        size_t tick = 0;
+        index.rebuild(npcs, &pool);
+        TickPacer pacer(MOVE_TICK);
+        while (move_gate.wait())
+        {
+            pacer.begin_tick();
             {
-                if (!attacker || !attacker->is_alive())
-                    continue;
-                const auto kill_distance = rules_for(attacker->get_type()).kill_distance;
+                TRACE_SCOPE("move_tick");
+                {
+                    TRACE_SCOPE("behaviours");
+                    std::lock_guard<std::mutex> density_lock(density_mutex);
+                    behaviours.tick();
+                }
+                ++tick;
+                {
+                    TRACE_SCOPE("index.rebuild");
+                    index.rebuild(npcs, &pool);
+                }
 
-                for (const auto &defender : npcs)
+                candidates.clear();
                 {
-                    if (attacker == defender || !defender || !defender->is_alive())
-                        continue;
-                    if (!can_attack(attacker->get_type(), defender->get_type()))
-                        continue;
+                    TRACE_SCOPE("detection");
+                    const auto [begin, end] = pacer.detection_slice(npcs.size());
+                    neighbours.update(npcs, index);
+                    neighbours.collect_candidates(npcs, candidates, begin, end);
+                    pacer.end_detection();
+                }
+                fight_queue.push(candidates, npcs.layout_version());
 
-                    if (attacker->is_close(defender, static_cast<size_t>(kill_distance)))
-                        fight_queue.push({attacker, defender});
+                if (snapshot_server)
+                {
+                    TRACE_SCOPE("snapshot.publish");
+                    snapshot_server->publish(
+                        WorldSnapshot::capture(npcs, tick, kills_observer->recent(), snapshot_server->current()));
                 }
             }
 
-            std::this_thread::sleep_for(MOVE_TICK);
+            pacer.finish_tick();
         }
+        tick_stats = pacer.stats();
+        neighbour_rebuilds = neighbours.rebuilds();
         fight_queue.request_stop();
     });
 
+    // Тики движения, кадры карты и конец игры — события одного колеса таймеров;
+    // главный поток спит только до ближайшего из них.
+    TimerWheel timers;
+    timers.schedule(to_wheel_ticks(MOVE_TICK), MoveTickEvent);
+    timers.schedule(to_wheel_ticks(PRINT_TICK), RenderEvent);
+    timers.schedule(to_wheel_ticks(GAME_DURATION), EndEvent);
+    print_map(density, density_mutex);
+
     const auto start = std::chrono::steady_clock::now();
-    while (std::chrono::steady_clock::now() - start < GAME_DURATION)
+    bool running = true;
+    while (running)
     {
-        print_map(npcs);
-        std::this_thread::sleep_for(PRINT_TICK);
+        timers.advance_to(to_wheel_ticks(std::chrono::steady_clock::now() - start), [&](TimerId, std::uint64_t event)
+                          {
+            switch (event)
+            {
+            case MoveTickEvent:
+                move_gate.post();
+                timers.schedule(to_wheel_ticks(MOVE_TICK), MoveTickEvent);
+                break;
+            case RenderEvent:
+                print_map(density, density_mutex);
+                timers.schedule(to_wheel_ticks(PRINT_TICK), RenderEvent);
+                break;
+            case EndEvent:
+                running = false;
+                break;
+            } });
+        if (!running)
+            break;
+        TRACE_SCOPE("timers.sleep");
+        const auto next = timers.now() + timers.ticks_until_next(to_wheel_ticks(PRINT_TICK));
+        std::this_thread::sleep_until(start + std::chrono::milliseconds(next));
     }
 
-    stop = true;
+    move_gate.stop();
     fight_queue.request_stop();
     move_thread.join();
     fight_thread.join();
 
+    console_observer->flush();
     print_survivors(npcs);
+    std::cout << "Move ticks: " << tick_stats.ticks << ", p50 " << tick_stats.p50.count() << " us, p99 "
+              << tick_stats.p99.count() << " us, overruns " << tick_stats.overruns << '\n';
+    std::cout << "Neighbour list rebuilds: " << neighbour_rebuilds << " of " << tick_stats.ticks << " ticks\n";
+
+    if (trace_path)
+    {
+        std::ofstream trace_file(trace_path);
+        trace_write_chrome(trace_file);
+    }
     return 0;
 }
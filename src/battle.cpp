@@ -1,9 +1,23 @@
 #include "../include/battle.h"
 
+#include "../include/format.h"
+#include "../include/resolver.h"
+#include "../include/rules.h"
+#include "../include/trace.h"
+
+#include <algorithm>
+#include <array>
 #include <cerrno>
 #include <cstring>
 #include <fstream>
 #include <iostream>
+#include <string>
+#include <vector>
+
+namespace
+{
+    constexpr size_t FORMAT_CHUNK = 64 * 1024;
+}
 
 void print_all(const set_t &array, std::ostream &os)
 {
@@ -12,8 +26,15 @@ void print_all(const set_t &array, std::ostream &os)
         os << "No NPCs\n";
         return;
     }
+    std::string buffer;
+    buffer.reserve(FORMAT_CHUNK);
     for (auto &npc : array)
-        os << *npc << '\n';
+    {
+        append_npc(buffer, *npc);
+        buffer.push_back('\n');
+        flush_buffer(os, buffer, FORMAT_CHUNK);
+    }
+    flush_buffer(os, buffer);
 }
 
 void save(const set_t &array, const std::string &filename)
@@ -45,46 +66,194 @@ set_t load(const std::string &filename, const std::vector<std::shared_ptr<IFight
 
 std::ostream &operator<<(std::ostream &os, const set_t &array)
 {
+    std::string buffer;
+    buffer.reserve(FORMAT_CHUNK);
     for (auto &n : array)
-        n->print();
+    {
+        append_npc_line(buffer, *n);
+        flush_buffer(os, buffer, FORMAT_CHUNK);
+    }
+    flush_buffer(os, buffer);
     return os;
 }
 
-set_t fight(const set_t &array, size_t distance)
+namespace
 {
-    set_t dead_list;
+    using BucketEntry = FightBuffers::BucketEntry;
+    using buckets_t = decltype(FightBuffers::buckets);
 
-    for (const auto &attacker : array)
+    // Живые NPC, разложенные по типам и отсортированные по x: хищник просматривает
+    // только полосу [x - distance, x + distance] в корзинах своих жертв.
+    void fill_buckets(const set_t &array, buckets_t &buckets)
     {
-        if (!attacker || !attacker->is_alive())
-            continue;
-        if (dead_list.count(attacker))
-            continue;
-        for (const auto &defender : array)
+        for (auto &bucket : buckets)
+            bucket.clear();
+        for (size_t i = 0; i < array.size(); ++i)
         {
-            if (attacker == defender || dead_list.count(defender) || !defender || !defender->is_alive())
-                continue;
-            if (!attacker->is_close(defender, distance))
+            const auto &npc = array[i];
+            if (!npc->is_alive())
                 continue;
+            buckets[npc->get_type()].push_back({npc->get_x(), i});
+        }
+        for (auto &bucket : buckets)
+            std::sort(bucket.begin(), bucket.end(), [](const BucketEntry &a, const BucketEntry &b)
+                      { return a.x < b.x || (a.x == b.x && a.index < b.index); });
+    }
 
-            const bool defender_dead = defender->accept(attacker);
-            const bool attacker_dead = attacker->accept(defender);
+    buckets_t make_buckets(const set_t &array)
+    {
+        buckets_t buckets;
+        fill_buckets(array, buckets);
+        return buckets;
+    }
+}
 
-            if (defender_dead)
-            {
-                defender->die();
-                dead_list.insert(defender);
-            }
-            if (attacker_dead)
+namespace
+{
+    // Кандидаты для атакующих с плотными индексами [begin, end) в порядке (атакующий, x жертвы).
+    void collect_candidates(const set_t &array, const buckets_t &buckets, size_t distance,
+                            size_t begin, size_t end, std::vector<FightCandidate> &out)
+    {
+        const auto reach = static_cast<long long>(distance);
+        for (size_t i = begin; i < end; ++i)
+        {
+            const auto &attacker = array[i];
+            const NpcType attacker_type = attacker->get_type();
+            if (!has_prey(attacker_type) || !attacker->is_alive())
+                continue;
+            const long long ax = attacker->get_x();
+
+            for (size_t t = 0; t < NPC_TYPE_COUNT; ++t)
             {
-                attacker->die();
-                dead_list.insert(attacker);
-                break;
+                if (!can_attack(attacker_type, static_cast<NpcType>(t)))
+                    continue;
+                const auto &bucket = buckets[t];
+                auto it = std::lower_bound(bucket.begin(), bucket.end(), ax - reach,
+                                           [](const BucketEntry &e, long long value)
+                                           { return e.x < value; });
+                for (; it != bucket.end() && it->x <= ax + reach; ++it)
+                {
+                    if (attacker->is_close(array[it->index], distance))
+                        out.push_back({static_cast<std::uint32_t>(i), static_cast<std::uint32_t>(it->index)});
+                }
             }
         }
     }
 
-    return dead_list;
+    set_t dead_from(const set_t &array, const FightResolver &resolver)
+    {
+        set_t dead_list;
+        for (const auto &outcome : resolver.outcomes())
+        {
+            if (outcome.win)
+                dead_list.insert(array[outcome.defender]);
+        }
+        return dead_list;
+    }
+
+    set_t resolve_candidates(const set_t &array, const std::vector<FightCandidate> &candidates)
+    {
+        FightResolver resolver;
+        {
+            TRACE_SCOPE("fight.resolve");
+            resolver.resolve(array, candidates, draw_seed());
+        }
+        TRACE_SCOPE("fight.notify");
+        resolver.notify(array);
+        return dead_from(array, resolver);
+    }
+}
+
+set_t fight(const set_t &array, size_t distance)
+{
+    TRACE_SCOPE("fight");
+    std::vector<FightCandidate> candidates;
+    {
+        TRACE_SCOPE("fight.collect");
+        const auto buckets = make_buckets(array);
+        collect_candidates(array, buckets, distance, 0, array.size(), candidates);
+    }
+    return resolve_candidates(array, candidates);
+}
+
+void FightBuffers::reserve(size_t npcs, size_t candidate_pairs)
+{
+    for (auto &bucket : buckets)
+        bucket.reserve(npcs);
+    candidates.reserve(candidate_pairs);
+    dead.reserve(npcs);
+}
+
+size_t fight_into(const set_t &array, size_t distance, FightBuffers &buffers)
+{
+    TRACE_SCOPE("fight");
+    buffers.candidates.clear();
+    {
+        TRACE_SCOPE("fight.collect");
+        fill_buckets(array, buffers.buckets);
+        collect_candidates(array, buffers.buckets, distance, 0, array.size(), buffers.candidates);
+    }
+    {
+        TRACE_SCOPE("fight.resolve");
+        // Каждый вызов — отдельный раунд, как у fight() со свежим резолвером.
+        buffers.resolver.reset();
+        buffers.resolver.resolve(array, buffers.candidates, draw_seed());
+    }
+    {
+        TRACE_SCOPE("fight.notify");
+        buffers.resolver.notify(array);
+    }
+
+    buffers.dead.clear();
+    for (const auto &outcome : buffers.resolver.outcomes())
+    {
+        if (outcome.win)
+            buffers.dead.push_back(outcome.defender);
+    }
+    return buffers.dead.size();
+}
+
+set_t fight_quiet(const set_t &array, size_t distance, FightResolver &resolver)
+{
+    TRACE_SCOPE("fight");
+    std::vector<FightCandidate> candidates;
+    {
+        TRACE_SCOPE("fight.collect");
+        const auto buckets = make_buckets(array);
+        collect_candidates(array, buckets, distance, 0, array.size(), candidates);
+    }
+    TRACE_SCOPE("fight.resolve");
+    resolver.resolve(array, candidates, draw_seed());
+    return dead_from(array, resolver);
+}
+
+set_t fight(const set_t &array, size_t distance, ThreadPool &pool)
+{
+    TRACE_SCOPE("fight");
+    const auto buckets = make_buckets(array);
+
+    // Каждый кусок атакующих собирает своих кандидатов без общих структур; склейка
+    // в порядке кусков даёт тот же список, что и последовательная версия.
+    const size_t chunks = std::min(array.size(), pool.size() * 4 + 1);
+    std::vector<std::vector<FightCandidate>> partial(chunks);
+    pool.parallel_for(chunks, [&](size_t first, size_t last)
+                      {
+        TRACE_SCOPE("fight.collect");
+        for (size_t c = first; c < last; ++c)
+        {
+            const size_t begin = array.size() * c / chunks;
+            const size_t end = array.size() * (c + 1) / chunks;
+            collect_candidates(array, buckets, distance, begin, end, partial[c]);
+        } });
+
+    size_t total = 0;
+    for (const auto &part : partial)
+        total += part.size();
+    std::vector<FightCandidate> candidates;
+    candidates.reserve(total);
+    for (const auto &part : partial)
+        candidates.insert(candidates.end(), part.begin(), part.end());
+    return resolve_candidates(array, candidates);
 }
 
 bool name_exists(const set_t &array, const std::string &name)
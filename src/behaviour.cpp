@@ -0,0 +1,331 @@
+#include "../include/behaviour.h"
+
+#include "../include/rules.h"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <utility>
+
+namespace
+{
+    constexpr size_t FRAME_CLASS_STEP = 64;
+    constexpr size_t FRAME_CLASS_COUNT = 16;
+    constexpr size_t BLOCKS_PER_CHUNK = 4096;
+
+    struct FreeBlock
+    {
+        FreeBlock *next;
+    };
+
+    // Общие чанки и списки, оставленные завершившимися потоками; мьютекс берётся только
+    // при пополнении локального списка, а не на каждый кадр.
+    struct SharedPool
+    {
+        std::mutex mtx;
+        std::array<FreeBlock *, FRAME_CLASS_COUNT> orphans{};
+        std::vector<std::unique_ptr<std::byte[]>> chunks;
+        size_t reserved{0};
+    };
+
+    SharedPool &shared_pool()
+    {
+        static SharedPool pool;
+        return pool;
+    }
+
+    void push_list(FreeBlock *&head, FreeBlock *first)
+    {
+        FreeBlock *last = first;
+        while (last->next)
+            last = last->next;
+        last->next = head;
+        head = first;
+    }
+
+    // Свободные блоки потока. Блок, освобождённый в другом потоке, попадает в список
+    // освободившего; при выходе потока его списки уходят в orphans.
+    struct LocalPool
+    {
+        std::array<FreeBlock *, FRAME_CLASS_COUNT> free_lists{};
+
+        ~LocalPool()
+        {
+            auto &shared = shared_pool();
+            std::lock_guard<std::mutex> lck(shared.mtx);
+            for (size_t cls = 0; cls < FRAME_CLASS_COUNT; ++cls)
+                if (free_lists[cls])
+                    push_list(shared.orphans[cls], std::exchange(free_lists[cls], nullptr));
+        }
+
+        void refill(size_t cls)
+        {
+            auto &shared = shared_pool();
+            std::lock_guard<std::mutex> lck(shared.mtx);
+            if (shared.orphans[cls])
+            {
+                free_lists[cls] = std::exchange(shared.orphans[cls], nullptr);
+                return;
+            }
+            const size_t block = (cls + 1) * FRAME_CLASS_STEP;
+            shared.chunks.push_back(std::make_unique<std::byte[]>(block * BLOCKS_PER_CHUNK));
+            shared.reserved += block * BLOCKS_PER_CHUNK;
+            std::byte *base = shared.chunks.back().get();
+            // Блоки связываются от конца к началу, чтобы выдача шла по возрастанию адресов.
+            for (size_t i = BLOCKS_PER_CHUNK; i-- > 0;)
+            {
+                auto *node = reinterpret_cast<FreeBlock *>(base + i * block);
+                node->next = free_lists[cls];
+                free_lists[cls] = node;
+            }
+        }
+    };
+
+    LocalPool &local_pool()
+    {
+        thread_local LocalPool pool;
+        return pool;
+    }
+
+    size_t frame_class(size_t size)
+    {
+        return (size + FRAME_CLASS_STEP - 1) / FRAME_CLASS_STEP - 1;
+    }
+}
+
+void *FramePool::allocate(size_t size)
+{
+    const size_t cls = frame_class(size);
+    if (cls >= FRAME_CLASS_COUNT)
+        return ::operator new(size);
+
+    auto &local = local_pool();
+    if (!local.free_lists[cls])
+        local.refill(cls);
+    FreeBlock *node = local.free_lists[cls];
+    local.free_lists[cls] = node->next;
+    return node;
+}
+
+void FramePool::deallocate(void *ptr, size_t size) noexcept
+{
+    const size_t cls = frame_class(size);
+    if (cls >= FRAME_CLASS_COUNT)
+    {
+        ::operator delete(ptr);
+        return;
+    }
+
+    auto &local = local_pool();
+    auto *node = static_cast<FreeBlock *>(ptr);
+    node->next = local.free_lists[cls];
+    local.free_lists[cls] = node;
+}
+
+size_t FramePool::reserved_bytes()
+{
+    auto &shared = shared_pool();
+    std::lock_guard<std::mutex> lck(shared.mtx);
+    return shared.reserved;
+}
+
+Behaviour Behaviour::promise_type::get_return_object() noexcept
+{
+    return Behaviour{handle_t::from_promise(*this)};
+}
+
+void Behaviour::promise_type::unhandled_exception() const noexcept
+{
+    std::terminate();
+}
+
+Behaviour &Behaviour::operator=(Behaviour &&other) noexcept
+{
+    if (this != &other)
+    {
+        if (handle)
+            handle.destroy();
+        handle = std::exchange(other.handle, {});
+    }
+    return *this;
+}
+
+Behaviour::~Behaviour()
+{
+    if (handle)
+        handle.destroy();
+}
+
+bool Behaviour::step()
+{
+    if (done())
+        return false;
+    auto &promise = handle.promise();
+    if (promise.sleep_ticks > 0)
+    {
+        --promise.sleep_ticks;
+        return true;
+    }
+    handle.resume();
+    return !handle.done();
+}
+
+namespace
+{
+    int toward(int from, int to, int step)
+    {
+        return std::clamp(to - from, -step, step);
+    }
+
+    int away(int from, int to, int step)
+    {
+        if (from == to)
+            return 0;
+        return from < to ? -step : step;
+    }
+
+    // Все перемещения поведений идут через step_by, чтобы сетка плотности не отставала.
+    void step_by(NPC &npc, BehaviourContext &ctx, int dx, int dy)
+    {
+        if (!ctx.density)
+        {
+            npc.move(dx, dy, ctx.max_x, ctx.max_y);
+            return;
+        }
+        const auto [from_x, from_y] = npc.position();
+        npc.move(dx, dy, ctx.max_x, ctx.max_y);
+        const auto [to_x, to_y] = npc.position();
+        ctx.density->move(npc.get_type(), from_x, from_y, to_x, to_y);
+    }
+
+    void random_step(NPC &npc, BehaviourContext &ctx, int step)
+    {
+        std::uniform_int_distribution<int> dist(-step, step);
+        const int dx = dist(ctx.rng);
+        const int dy = dist(ctx.rng);
+        step_by(npc, ctx, dx, dy);
+    }
+}
+
+Behaviour wander(std::shared_ptr<NPC> npc, BehaviourContext &ctx)
+{
+    const int step = rules_for(npc->get_type()).step;
+    while (npc->is_alive())
+    {
+        random_step(*npc, ctx, step);
+        co_await next_tick();
+    }
+}
+
+Behaviour patrol(std::shared_ptr<NPC> npc, BehaviourContext &ctx, std::vector<std::pair<int, int>> waypoints)
+{
+    const int step = rules_for(npc->get_type()).step;
+    size_t next = 0;
+    while (npc->is_alive())
+    {
+        if (waypoints.empty())
+            random_step(*npc, ctx, step);
+        else
+        {
+            const auto [x, y] = npc->position();
+            const auto [tx, ty] = waypoints[next];
+            if (x == tx && y == ty)
+                next = (next + 1) % waypoints.size();
+            else
+                step_by(*npc, ctx, toward(x, tx, step), toward(y, ty, step));
+        }
+        co_await next_tick();
+    }
+}
+
+Behaviour chase(std::shared_ptr<NPC> npc, BehaviourContext &ctx, std::weak_ptr<NPC> target)
+{
+    const int step = rules_for(npc->get_type()).step;
+    while (npc->is_alive())
+    {
+        auto prey = target.lock();
+        if (prey && prey->is_alive())
+        {
+            const auto [x, y] = npc->position();
+            const auto [tx, ty] = prey->position();
+            step_by(*npc, ctx, toward(x, tx, step), toward(y, ty, step));
+        }
+        else
+            random_step(*npc, ctx, step);
+        co_await next_tick();
+    }
+}
+
+Behaviour flee(std::shared_ptr<NPC> npc, BehaviourContext &ctx, std::weak_ptr<NPC> threat)
+{
+    const int step = rules_for(npc->get_type()).step;
+    while (npc->is_alive())
+    {
+        auto hunter = threat.lock();
+        if (hunter && hunter->is_alive())
+        {
+            const auto [x, y] = npc->position();
+            const auto [tx, ty] = hunter->position();
+            step_by(*npc, ctx, away(x, tx, step), away(y, ty, step));
+        }
+        else
+            random_step(*npc, ctx, step);
+        co_await next_tick();
+    }
+}
+
+Behaviour hunt(std::shared_ptr<NPC> npc, BehaviourContext &ctx, const SpatialIndex &index, const set_t &npcs)
+{
+    const int step = rules_for(npc->get_type()).step;
+    const TypeMask mask = prey_mask(npc->get_type());
+    while (npc->is_alive())
+    {
+        const auto [x, y] = npc->position();
+        const auto hit = mask ? index.nearest(x, y, mask) : std::nullopt;
+        if (hit && hit->index < npcs.size())
+        {
+            const auto [tx, ty] = npcs[hit->index]->position();
+            step_by(*npc, ctx, toward(x, tx, step), toward(y, ty, step));
+        }
+        else
+            random_step(*npc, ctx, step);
+        co_await next_tick();
+    }
+}
+
+BehaviourScheduler::BehaviourScheduler(int max_x, int max_y, unsigned int seed)
+    : ctx{max_x, max_y, std::mt19937{seed}, nullptr}
+{
+}
+
+void BehaviourScheduler::spawn(Behaviour behaviour)
+{
+    if (!behaviour.done())
+        tasks.push_back(std::move(behaviour));
+}
+
+void BehaviourScheduler::tick()
+{
+    for (auto &task : tasks)
+    {
+        if (!task.done() && !task.step())
+            ++finished;
+    }
+    if (finished * 4 > tasks.size())
+        compact();
+}
+
+void BehaviourScheduler::compact()
+{
+    std::erase_if(tasks, [](const Behaviour &task)
+                  { return task.done(); });
+    // Порядок по адресу кадра: кадры лежат в чанках пула, обход идёт почти последовательно.
+    std::sort(tasks.begin(), tasks.end(), [](const Behaviour &a, const Behaviour &b)
+              { return std::less<const void *>{}(a.frame(), b.frame()); });
+    finished = 0;
+}
@@ -0,0 +1,298 @@
+#include "../include/delta_save.h"
+
+#include "../include/battle.h"
+#include "../include/resolver.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <unistd.h>
+#include <unordered_map>
+
+namespace
+{
+    constexpr const char *SEGMENT_TAG = "# segment";
+    constexpr const char *BASE_TAG = "# base";
+
+    void write_delta(std::string &out, const NPC &npc)
+    {
+        const auto [x, y] = npc.position();
+        out += std::to_string(static_cast<int>(npc.get_type()));
+        out += ' ';
+        out += npc.get_name();
+        out += ' ';
+        out += std::to_string(x);
+        out += ' ';
+        out += std::to_string(y);
+        out += npc.is_alive() ? " 1\n" : " 0\n";
+    }
+
+    void write_segment(std::ostream &os, size_t number, size_t count, const std::string &body)
+    {
+        os << SEGMENT_TAG << ' ' << number << ' ' << count << '\n'
+           << body;
+    }
+
+    bool sync_path(const std::string &path)
+    {
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        const bool ok = ::fsync(fd) == 0;
+        ::close(fd);
+        return ok;
+    }
+
+    std::string directory_of(const std::string &path)
+    {
+        const auto parent = std::filesystem::path(path).parent_path();
+        return parent.empty() ? std::string(".") : parent.string();
+    }
+
+    // Метка пары «снимок + журнал»: журнал с чужой меткой при загрузке не применяется.
+    std::string make_stamp(size_t compaction)
+    {
+        const auto now = std::chrono::steady_clock::now().time_since_epoch().count();
+        return std::to_string(counter_bits(static_cast<std::uint64_t>(now), compaction));
+    }
+
+    struct DeltaRecord
+    {
+        int type;
+        std::string name;
+        int x;
+        int y;
+        int alive;
+    };
+
+    struct Journal
+    {
+        std::string stamp;
+        std::vector<DeltaRecord> records;
+    };
+
+    // Необязательная строка "# base <метка>", затем сегменты по порядку;
+    // чтение останавливается на первом неполном сегменте.
+    Journal read_journal(std::istream &is)
+    {
+        Journal journal;
+        auto &records = journal.records;
+        std::string line;
+        bool first = true;
+        while (std::getline(is, line))
+        {
+            if (first && line.rfind(BASE_TAG, 0) == 0)
+            {
+                std::istringstream(line.substr(std::char_traits<char>::length(BASE_TAG))) >> journal.stamp;
+                first = false;
+                continue;
+            }
+            first = false;
+            if (line.rfind(SEGMENT_TAG, 0) != 0)
+                break;
+            std::istringstream header(line.substr(std::char_traits<char>::length(SEGMENT_TAG)));
+            size_t number{0};
+            size_t count{0};
+            if (!(header >> number >> count))
+                break;
+
+            std::vector<DeltaRecord> segment;
+            segment.reserve(count);
+            for (size_t i = 0; i < count && std::getline(is, line); ++i)
+            {
+                std::istringstream ls(line);
+                DeltaRecord r;
+                if (!(ls >> r.type >> r.name >> r.x >> r.y >> r.alive))
+                    break;
+                segment.push_back(std::move(r));
+            }
+            if (segment.size() != count)
+                break;
+            records.insert(records.end(), std::make_move_iterator(segment.begin()),
+                           std::make_move_iterator(segment.end()));
+        }
+        return journal;
+    }
+
+    // Хвост базового снимка после записей в формате save().
+    Journal read_base_trailer(const std::string &path)
+    {
+        std::ifstream is(path);
+        size_t count = 0;
+        if (!(is >> count))
+            return {};
+        std::string line;
+        std::getline(is, line);
+        for (size_t i = 0; i < count && std::getline(is, line); ++i)
+        {
+        }
+        return read_journal(is);
+    }
+}
+
+DeltaSaver::DeltaSaver(std::string base_path, DeltaSaveOptions options)
+    : base(std::move(base_path)), delta(base + ".delta"), options(options)
+{
+}
+
+bool DeltaSaver::compact(const set_t &array)
+{
+    // Флаги снимаются до сериализации, как в append(): изменение во время записи
+    // попадёт в снимок и снова пометит NPC, а не потеряется.
+    for (const auto &npc : array)
+        npc->take_dirty();
+    // При любой ошибке ниже следующий append() снова делает полный снимок.
+    force_compact = true;
+
+    // Снимок пишется рядом и атомарно подменяет базовый файл; до rename() на диске
+    // остаётся прежняя согласованная пара «снимок + журнал».
+    std::string body;
+    size_t dead = 0;
+    for (const auto &npc : array)
+    {
+        if (!npc->is_alive())
+        {
+            write_delta(body, *npc);
+            ++dead;
+        }
+    }
+    const std::string stamp = make_stamp(compaction_count);
+    const std::string temporary = base + ".tmp";
+    {
+        std::ofstream fs(temporary, std::ios::out | std::ios::trunc);
+        fs << array.size() << '\n';
+        for (const auto &npc : array)
+            npc->save(fs);
+        // Мёртвые хранятся в самом снимке: формат save() не знает флага alive.
+        fs << BASE_TAG << ' ' << stamp << '\n';
+        write_segment(fs, 0, dead, body);
+        fs.flush();
+        if (!fs)
+        {
+            std::cerr << "Error: cannot write " << temporary << std::endl;
+            return false;
+        }
+    }
+    if (!sync_path(temporary) || std::rename(temporary.c_str(), base.c_str()) != 0)
+    {
+        std::cerr << "Error: " << std::strerror(errno) << std::endl;
+        std::remove(temporary.c_str());
+        return false;
+    }
+    const std::string directory = directory_of(base);
+    if (!sync_path(directory))
+    {
+        std::cerr << "Error: " << directory << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+
+    // Сбой до этой строки оставит старый журнал с чужой меткой — он будет проигнорирован.
+    {
+        std::ofstream fs(delta, std::ios::out | std::ios::trunc);
+        fs << BASE_TAG << ' ' << stamp << '\n';
+        fs.flush();
+        if (!fs)
+        {
+            std::cerr << "Error: cannot write " << delta << std::endl;
+            return false;
+        }
+    }
+    if (!sync_path(delta) || !sync_path(directory))
+    {
+        std::cerr << "Error: " << delta << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    force_compact = false;
+    segments = 1;
+    delta_records = dead;
+    ++compaction_count;
+    return true;
+}
+
+size_t DeltaSaver::append(const set_t &array)
+{
+    std::string body;
+    size_t count = 0;
+    for (const auto &npc : array)
+    {
+        if (!npc->take_dirty())
+            continue;
+        write_delta(body, *npc);
+        ++count;
+    }
+
+    // Первый вызов всегда пишет полный снимок: файлы на диске могут быть от другого мира.
+    // После неудачного сжатия — тоже: флаги, снятые им, в журнал уже не попадут.
+    if (force_compact ||
+        static_cast<double>(delta_records + count) > options.compact_ratio * static_cast<double>(array.size()))
+    {
+        if (compact(array))
+            return count;
+        // Снимка на диске нет — журналу не к чему относиться.
+        if (compaction_count == 0)
+            return 0;
+        // Иначе изменения уходят в журнал к прежнему снимку.
+    }
+    if (count == 0)
+        return 0;
+    std::ofstream fs(delta, std::ios::out | std::ios::app);
+    write_segment(fs, segments++, count, body);
+    fs.flush();
+    delta_records += count;
+    return count;
+}
+
+set_t load_with_deltas(const std::string &base_path, const std::vector<std::shared_ptr<IFightObserver>> &observers)
+{
+    set_t result = load(base_path, observers);
+
+    // Записи журнала сопоставляются по имени, поэтому одинаковые имена неразличимы.
+    std::unordered_map<std::string, std::shared_ptr<NPC>> by_name;
+    by_name.reserve(result.size());
+    for (const auto &npc : result)
+    {
+        if (!by_name.emplace(npc->get_name(), npc).second)
+        {
+            std::cerr << base_path << ": duplicate NPC name " << npc->get_name() << std::endl;
+            return {};
+        }
+    }
+
+    auto records = read_base_trailer(base_path);
+    std::ifstream delta(base_path + ".delta");
+    auto journal = read_journal(delta);
+    if (journal.stamp == records.stamp)
+        records.records.insert(records.records.end(), std::make_move_iterator(journal.records.begin()),
+                               std::make_move_iterator(journal.records.end()));
+
+    for (const auto &r : records.records)
+    {
+        auto it = by_name.find(r.name);
+        std::shared_ptr<NPC> npc;
+        if (it != by_name.end())
+        {
+            npc = it->second;
+            npc->set_position(r.x, r.y);
+        }
+        else
+        {
+            npc = factory(static_cast<NpcType>(r.type), r.name, r.x, r.y, observers);
+            if (!npc)
+                continue;
+            result.insert(npc);
+            by_name.emplace(r.name, npc);
+        }
+        if (!r.alive)
+            npc->die();
+    }
+
+    for (const auto &npc : result)
+        npc->take_dirty();
+    return result;
+}
@@ -0,0 +1,130 @@
+#include "../include/density.h"
+
+#include <algorithm>
+
+DensityGrid::DensityGrid(int width, int height, int cell)
+    : cell_size(std::max(1, cell)),
+      cols(std::max(0, width) / cell_size + 1),
+      rws(std::max(0, height) / cell_size + 1)
+{
+    for (auto &c : counts)
+        c.assign(static_cast<size_t>(cols) * rws, 0);
+    for (auto &s : sums)
+        s.assign(static_cast<size_t>(cols + 1) * (rws + 1), 0);
+}
+
+int DensityGrid::cell_of(int x, int y) const noexcept
+{
+    const int cx = std::clamp(x / cell_size, 0, cols - 1);
+    const int cy = std::clamp(y / cell_size, 0, rws - 1);
+    return cy * cols + cx;
+}
+
+void DensityGrid::add(NpcType type, int x, int y)
+{
+    ++counts[type][cell_of(x, y)];
+    ++totals[type];
+    stale = true;
+}
+
+void DensityGrid::remove(NpcType type, int x, int y)
+{
+    --counts[type][cell_of(x, y)];
+    --totals[type];
+    stale = true;
+}
+
+void DensityGrid::move(NpcType type, int from_x, int from_y, int to_x, int to_y)
+{
+    const int from = cell_of(from_x, from_y);
+    const int to = cell_of(to_x, to_y);
+    if (from == to)
+        return;
+    --counts[type][from];
+    ++counts[type][to];
+    stale = true;
+}
+
+void DensityGrid::clear()
+{
+    for (auto &c : counts)
+        std::fill(c.begin(), c.end(), 0);
+    totals.fill(0);
+    stale = true;
+}
+
+void DensityGrid::rebuild(const set_t &npcs)
+{
+    clear();
+    for (const auto &npc : npcs)
+    {
+        if (!npc->is_alive())
+            continue;
+        const auto [x, y] = npc->position();
+        add(npc->get_type(), x, y);
+    }
+}
+
+void DensityGrid::remove_killed(const NpcStore &npcs, std::span<const FightOutcome> outcomes)
+{
+    for (const auto &outcome : outcomes)
+    {
+        if (!outcome.win || outcome.defender >= npcs.size())
+            continue;
+        const auto &npc = npcs[outcome.defender];
+        const auto [x, y] = npc->position();
+        remove(npc->get_type(), x, y);
+    }
+}
+
+size_t DensityGrid::cell(NpcType type, int cx, int cy) const
+{
+    if (cx < 0 || cy < 0 || cx >= cols || cy >= rws)
+        return 0;
+    return counts[type][static_cast<size_t>(cy) * cols + cx];
+}
+
+void DensityGrid::prepare() const
+{
+    if (!stale)
+        return;
+    const size_t stride = static_cast<size_t>(cols) + 1;
+    for (size_t type = 0; type < NPC_TYPE_COUNT; ++type)
+    {
+        const auto &c = counts[type];
+        auto &s = sums[type];
+        for (int cy = 0; cy < rws; ++cy)
+        {
+            std::uint32_t row = 0;
+            for (int cx = 0; cx < cols; ++cx)
+            {
+                row += c[static_cast<size_t>(cy) * cols + cx];
+                s[(cy + 1) * stride + cx + 1] = s[cy * stride + cx + 1] + row;
+            }
+        }
+    }
+    stale = false;
+}
+
+size_t DensityGrid::count_cells(NpcType type, int cx0, int cy0, int cx1, int cy1) const
+{
+    cx0 = std::clamp(cx0, 0, cols);
+    cx1 = std::clamp(cx1, 0, cols);
+    cy0 = std::clamp(cy0, 0, rws);
+    cy1 = std::clamp(cy1, 0, rws);
+    if (cx0 >= cx1 || cy0 >= cy1)
+        return 0;
+    prepare();
+    const size_t stride = static_cast<size_t>(cols) + 1;
+    const auto &s = sums[type];
+    return s[cy1 * stride + cx1] - s[cy0 * stride + cx1] - s[cy1 * stride + cx0] + s[cy0 * stride + cx0];
+}
+
+size_t DensityGrid::count(NpcType type, int x0, int y0, int x1, int y1) const
+{
+    if (x0 > x1 || y0 > y1)
+        return 0;
+    const auto to_cell = [this](int v)
+    { return v < 0 ? -1 : v / cell_size; };
+    return count_cells(type, to_cell(x0), to_cell(y0), to_cell(x1) + 1, to_cell(y1) + 1);
+}
@@ -39,7 +39,7 @@ bool Druid::fight(const std::shared_ptr<Druid> &other)
 
 void Druid::print() const
 {
-    std::cout << "Druid " << name << " (" << get_x() << ", " << get_y() << ")" << std::endl;
+    print_to(std::cout);
 }
 
 void Druid::save(std::ostream &os) const
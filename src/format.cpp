@@ -0,0 +1,69 @@
+#include "../include/format.h"
+
+#include <charconv>
+
+namespace
+{
+    void append_int(std::string &out, int value)
+    {
+        char digits[16];
+        const auto result = std::to_chars(digits, digits + sizeof(digits), value);
+        out.append(digits, result.ptr);
+    }
+}
+
+std::string_view type_name(NpcType type)
+{
+    switch (type)
+    {
+    case OrkType:
+        return "Ork";
+    case SquirrelType:
+        return "Squirrel";
+    case DruidType:
+        return "Druid";
+    default:
+        return "Unknown";
+    }
+}
+
+void append_npc(std::string &out, const NPC &npc)
+{
+    const auto [x, y] = npc.position();
+    out.append(type_name(npc.get_type()));
+    out.push_back(' ');
+    out.append(npc.get_name());
+    out.append(" {");
+    append_int(out, x);
+    out.append(", ");
+    append_int(out, y);
+    out.push_back('}');
+}
+
+void append_npc_line(std::string &out, const NPC &npc)
+{
+    const auto [x, y] = npc.position();
+    out.append(type_name(npc.get_type()));
+    out.push_back(' ');
+    out.append(npc.get_name());
+    out.append(" (");
+    append_int(out, x);
+    out.append(", ");
+    append_int(out, y);
+    out.append(")\n");
+}
+
+void flush_buffer(std::ostream &os, std::string &buffer, size_t threshold)
+{
+    if (buffer.size() < threshold || buffer.empty())
+        return;
+    os.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+    buffer.clear();
+}
+
+std::string &format_scratch()
+{
+    thread_local std::string buffer;
+    buffer.clear();
+    return buffer;
+}
@@ -0,0 +1,276 @@
+#include "../include/loader.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+    // Минимальный кусок текста на поток: меньше — накладные расходы дороже разбора.
+    constexpr size_t MIN_RANGE_BYTES = 64 * 1024;
+
+    class MappedFile
+    {
+    public:
+        explicit MappedFile(const std::string &filename)
+        {
+            const int fd = ::open(filename.c_str(), O_RDONLY);
+            if (fd < 0)
+                return;
+            struct stat st;
+            if (::fstat(fd, &st) == 0)
+            {
+                size = static_cast<size_t>(st.st_size);
+                ok = true;
+                if (size != 0)
+                {
+                    void *mapped = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+                    if (mapped == MAP_FAILED)
+                        ok = false;
+                    else
+                    {
+                        data = static_cast<const char *>(mapped);
+                        ::madvise(mapped, size, MADV_SEQUENTIAL);
+                    }
+                }
+            }
+            const int saved = errno;
+            ::close(fd);
+            errno = saved;
+        }
+
+        ~MappedFile()
+        {
+            if (data)
+                ::munmap(const_cast<char *>(data), size);
+        }
+
+        MappedFile(const MappedFile &) = delete;
+        MappedFile &operator=(const MappedFile &) = delete;
+
+        bool good() const noexcept { return ok; }
+        std::string_view text() const noexcept { return data ? std::string_view(data, size) : std::string_view(); }
+
+    private:
+        const char *data{nullptr};
+        size_t size{0};
+        bool ok{false};
+    };
+
+    bool is_space(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\r';
+    }
+
+    std::string_view next_token(std::string_view line, size_t &pos)
+    {
+        while (pos < line.size() && is_space(line[pos]))
+            ++pos;
+        const size_t begin = pos;
+        while (pos < line.size() && !is_space(line[pos]))
+            ++pos;
+        return line.substr(begin, pos - begin);
+    }
+
+    template <class T>
+    bool parse_number(std::string_view token, T &value)
+    {
+        if (token.empty())
+            return false;
+        const auto [end, ec] = std::from_chars(token.data(), token.data() + token.size(), value);
+        return ec == std::errc() && end == token.data() + token.size();
+    }
+
+    std::string quoted(std::string_view token)
+    {
+        return "'" + std::string(token) + "'";
+    }
+
+    // Разбор одной строки записи; пустые строки не считаются записями.
+    bool parse_line(std::string_view line, NpcRecord &record, std::string &error)
+    {
+        size_t pos = 0;
+        const auto type_token = next_token(line, pos);
+        int type_value{0};
+        if (!parse_number(type_token, type_value))
+        {
+            error = "bad NPC type " + quoted(type_token);
+            return false;
+        }
+        if (type_value != OrkType && type_value != SquirrelType && type_value != DruidType)
+        {
+            error = "unexpected NPC type:" + std::to_string(type_value);
+            return false;
+        }
+
+        record.type = static_cast<NpcType>(type_value);
+        record.name = next_token(line, pos);
+        if (record.name.empty())
+        {
+            error = "missing name";
+            return false;
+        }
+        const auto x_token = next_token(line, pos);
+        if (!parse_number(x_token, record.x))
+        {
+            error = "bad x " + quoted(x_token);
+            return false;
+        }
+        const auto y_token = next_token(line, pos);
+        if (!parse_number(y_token, record.y))
+        {
+            error = "bad y " + quoted(y_token);
+            return false;
+        }
+        const auto rest = next_token(line, pos);
+        if (!rest.empty())
+        {
+            error = "unexpected trailing text " + quoted(rest);
+            return false;
+        }
+        return true;
+    }
+
+    bool blank(std::string_view line)
+    {
+        for (char c : line)
+            if (!is_space(c))
+                return false;
+        return true;
+    }
+
+    struct RangeResult
+    {
+        std::vector<NpcRecord> records;
+        std::vector<LoadError> errors; // line — номер внутри куска
+        size_t lines{0};
+    };
+
+    void parse_range(std::string_view text, RangeResult &out)
+    {
+        std::string error;
+        size_t pos = 0;
+        while (pos < text.size())
+        {
+            size_t end = text.find('\n', pos);
+            if (end == std::string_view::npos)
+                end = text.size();
+            const auto line = text.substr(pos, end - pos);
+            ++out.lines;
+            if (!blank(line))
+            {
+                NpcRecord record;
+                if (parse_line(line, record, error))
+                    out.records.push_back(record);
+                else
+                    out.errors.push_back({out.lines, std::move(error)});
+            }
+            pos = end + 1;
+        }
+    }
+
+    // Границы кусков: каждый начинается сразу после '\n'.
+    std::vector<size_t> split_ranges(std::string_view text, size_t parts)
+    {
+        std::vector<size_t> bounds{0};
+        const size_t step = std::max(MIN_RANGE_BYTES, (text.size() + parts - 1) / parts);
+        while (bounds.back() < text.size())
+        {
+            size_t next = bounds.back() + step;
+            if (next >= text.size())
+                next = text.size();
+            else
+            {
+                next = text.find('\n', next);
+                next = next == std::string_view::npos ? text.size() : next + 1;
+            }
+            bounds.push_back(next);
+        }
+        return bounds;
+    }
+}
+
+size_t parse_npc_records(std::string_view text, ThreadPool &pool, std::vector<NpcRecord> &records,
+                         std::vector<LoadError> &errors)
+{
+    records.clear();
+    errors.clear();
+
+    const size_t header_end = std::min(text.find('\n'), text.size());
+    const auto header = text.substr(0, header_end);
+    size_t pos = 0;
+    const auto count_token = next_token(header, pos);
+    size_t count{0};
+    if (!parse_number(count_token, count) || !next_token(header, pos).empty())
+    {
+        errors.push_back({1, "bad record count " + quoted(header)});
+        return 0;
+    }
+
+    const auto body = header_end < text.size() ? text.substr(header_end + 1) : std::string_view();
+    const auto bounds = split_ranges(body, pool.size() + 1);
+    std::vector<RangeResult> ranges(bounds.size() - 1);
+    pool.parallel_for(ranges.size(), [&](size_t begin, size_t end)
+                      {
+        for (size_t r = begin; r < end; ++r)
+            parse_range(body.substr(bounds[r], bounds[r + 1] - bounds[r]), ranges[r]); });
+
+    size_t total = 0;
+    for (const auto &range : ranges)
+        total += range.records.size();
+    records.reserve(total);
+
+    size_t line_base = 1; // строка заголовка
+    for (auto &range : ranges)
+    {
+        records.insert(records.end(), range.records.begin(), range.records.end());
+        for (auto &error : range.errors)
+            errors.push_back({line_base + error.line, std::move(error.message)});
+        line_base += range.lines;
+    }
+
+    if (records.size() < count)
+        errors.push_back({line_base, "expected " + std::to_string(count) + " records, found " +
+                                         std::to_string(records.size())});
+    return count;
+}
+
+set_t load_parallel(const std::string &filename, const std::vector<std::shared_ptr<IFightObserver>> &observers,
+                    ThreadPool &pool)
+{
+    set_t result;
+    MappedFile file(filename);
+    if (!file.good())
+    {
+        std::cerr << "Error: " << std::strerror(errno) << std::endl;
+        return result;
+    }
+
+    std::vector<NpcRecord> records;
+    std::vector<LoadError> errors;
+    const size_t count = parse_npc_records(file.text(), pool, records, errors);
+    for (const auto &error : errors)
+        std::cerr << filename << ':' << error.line << ": " << error.message << std::endl;
+
+    // Объекты создаются параллельно, вставка — в порядке файла.
+    records.resize(std::min(records.size(), count));
+    std::vector<std::shared_ptr<NPC>> npcs(records.size());
+    pool.parallel_for(records.size(), [&](size_t begin, size_t end)
+                      {
+        for (size_t i = begin; i < end; ++i)
+        {
+            const auto &r = records[i];
+            npcs[i] = factory(r.type, std::string(r.name), r.x, r.y, observers);
+        } });
+
+    result.reserve(npcs.size());
+    for (const auto &npc : npcs)
+        result.insert(npc);
+    return result;
+}
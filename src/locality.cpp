@@ -0,0 +1,67 @@
+#include "../include/locality.h"
+
+#include <algorithm>
+#include <numeric>
+#include <vector>
+
+namespace
+{
+    std::uint32_t spread_bits(std::uint32_t v)
+    {
+        v &= 0x0000FFFFu;
+        v = (v | (v << 8)) & 0x00FF00FFu;
+        v = (v | (v << 4)) & 0x0F0F0F0Fu;
+        v = (v | (v << 2)) & 0x33333333u;
+        v = (v | (v << 1)) & 0x55555555u;
+        return v;
+    }
+
+    std::uint32_t key_of(const NPC &npc)
+    {
+        const auto [x, y] = npc.position();
+        return morton_key(x, y);
+    }
+}
+
+std::uint32_t morton_key(int x, int y)
+{
+    const auto ux = static_cast<std::uint32_t>(std::clamp(x, 0, 0xFFFF));
+    const auto uy = static_cast<std::uint32_t>(std::clamp(y, 0, 0xFFFF));
+    return spread_bits(ux) | (spread_bits(uy) << 1);
+}
+
+double morton_disorder(const set_t &npcs)
+{
+    if (npcs.size() < 2)
+        return 0.0;
+    size_t descents = 0;
+    std::uint32_t previous = key_of(*npcs[0]);
+    for (size_t i = 1; i < npcs.size(); ++i)
+    {
+        const std::uint32_t key = key_of(*npcs[i]);
+        descents += key < previous;
+        previous = key;
+    }
+    return static_cast<double>(descents) / static_cast<double>(npcs.size() - 1);
+}
+
+void sort_by_morton(set_t &npcs)
+{
+    std::vector<std::uint32_t> keys(npcs.size());
+    for (size_t i = 0; i < npcs.size(); ++i)
+        keys[i] = key_of(*npcs[i]);
+
+    std::vector<size_t> order(npcs.size());
+    std::iota(order.begin(), order.end(), size_t{0});
+    std::stable_sort(order.begin(), order.end(), [&keys](size_t a, size_t b)
+                     { return keys[a] < keys[b]; });
+    npcs.permute(order);
+}
+
+bool resort_if_disordered(set_t &npcs, double threshold)
+{
+    if (morton_disorder(npcs) <= threshold)
+        return false;
+    sort_by_morton(npcs);
+    return true;
+}
@@ -0,0 +1,106 @@
+#include "../include/monte_carlo.h"
+
+#include "../include/movement.h"
+#include "../include/packed.h"
+#include "../include/resolver.h"
+
+#include <algorithm>
+
+namespace
+{
+    // Буферы одного рабочего: мир и всё, что нужно fight_packed, живут между прогонами.
+    struct WorldScratch
+    {
+        PackedWorld world;
+        PackedFightScratch fight;
+        std::vector<FightOutcome> outcomes;
+    };
+
+    int kill_distance()
+    {
+        int distance = 0;
+        for (size_t type = 0; type < NPC_TYPE_COUNT; ++type)
+            if (has_prey(static_cast<NpcType>(type)))
+                distance = std::max(distance, rules_for(static_cast<NpcType>(type)).kill_distance);
+        return distance;
+    }
+
+    RunResult run_in(WorldScratch &scratch, const WorldParams &params, std::uint64_t seed)
+    {
+        RunResult result;
+        auto &world = scratch.world;
+        world.clear();
+        world.reserve(params.npcs);
+
+        // Расстановка как в task7: тип 1..3, координаты в [0, width) x [0, height).
+        for (size_t i = 0; i < params.npcs; ++i)
+        {
+            const std::uint64_t bits = counter_bits(seed, i);
+            const auto type = static_cast<NpcType>(1 + ((bits & 0xFFFF) * 3 >> 16));
+            const auto x = static_cast<int>(((bits >> 16) & 0xFFFF) * static_cast<std::uint64_t>(params.width) >> 16);
+            const auto y = static_cast<int>(((bits >> 32) & 0xFFFF) * static_cast<std::uint64_t>(params.height) >> 16);
+            if (world.add(type, {}, x, y))
+                ++result.initial[type];
+        }
+
+        const auto distance = static_cast<size_t>(kill_distance());
+        const std::uint64_t tick_seed = counter_bits(seed, params.npcs);
+        for (size_t tick = 0; tick < params.ticks; ++tick)
+        {
+            move_packed(world.records(), params.width - 1, params.height - 1, counter_bits(tick_seed, 2 * tick));
+            fight_packed(world, distance, counter_bits(tick_seed, 2 * tick + 1), scratch.outcomes, scratch.fight);
+        }
+
+        for (const auto &record : world.records())
+            if (record.alive())
+                ++result.survivors[record.type()];
+        return result;
+    }
+}
+
+void SurvivorHistogram::add(const RunResult &result)
+{
+    for (size_t type = 0; type < NPC_TYPE_COUNT; ++type)
+    {
+        auto &bins = counts[type];
+        const size_t k = result.survivors[type];
+        if (bins.size() <= k)
+            bins.resize(k + 1, 0);
+        ++bins[k];
+    }
+    ++runs;
+}
+
+double SurvivorHistogram::mean(NpcType type) const
+{
+    if (runs == 0)
+        return 0.0;
+    const auto &bins = counts[type];
+    size_t total = 0;
+    for (size_t k = 0; k < bins.size(); ++k)
+        total += k * bins[k];
+    return static_cast<double>(total) / static_cast<double>(runs);
+}
+
+RunResult run_world(const WorldParams &params, std::uint64_t seed)
+{
+    WorldScratch scratch;
+    return run_in(scratch, params, seed);
+}
+
+BatchRunner::BatchRunner(ThreadPool &pool, WorldParams params) : pool(pool), params(params) {}
+
+SurvivorHistogram BatchRunner::run(size_t runs, std::uint64_t base_seed)
+{
+    last.assign(runs, RunResult{});
+    pool.parallel_for(runs, [&](size_t begin, size_t end)
+                      {
+        WorldScratch scratch;
+        for (size_t r = begin; r < end; ++r)
+            last[r] = run_in(scratch, params, counter_bits(base_seed, r)); });
+
+    SurvivorHistogram histogram;
+    for (const auto &result : last)
+        histogram.add(result);
+    return histogram;
+}
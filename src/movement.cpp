@@ -0,0 +1,71 @@
+#include "../include/movement.h"
+
+#include "../include/resolver.h"
+#include "../include/rules.h"
+
+#include <algorithm>
+#include <array>
+
+namespace
+{
+    constexpr size_t MOVE_CHUNK = 64 * 1024;
+
+    // Шаг по полному байту meta: у мёртвых (без ALIVE_BIT) шаг 0.
+    std::array<std::int32_t, 256> make_step_table()
+    {
+        std::array<std::int32_t, 256> table{};
+        for (size_t meta = 0; meta < table.size(); ++meta)
+        {
+            const auto type = static_cast<NpcType>(meta & NpcHot::TYPE_MASK);
+            table[meta] = (meta & NpcHot::ALIVE_BIT) ? rules_for(type).step : 0;
+        }
+        return table;
+    }
+
+    const std::array<std::int32_t, 256> &step_table()
+    {
+        static const auto table = make_step_table();
+        return table;
+    }
+
+    void move_range(NpcHot *records, size_t begin, size_t end, int max_x, int max_y, std::uint64_t seed)
+    {
+        const auto &steps = step_table();
+        for (size_t i = begin; i < end; ++i)
+        {
+            NpcHot &r = records[i];
+            const std::uint64_t bits = counter_bits(seed, i);
+            const std::int32_t step = steps[r.meta];
+            const auto range = static_cast<std::uint64_t>(2 * step + 1);
+            const auto dx = static_cast<std::int32_t>(((bits & 0xFFFFFFFFull) * range) >> 32) - step;
+            const auto dy = static_cast<std::int32_t>(((bits >> 32) * range) >> 32) - step;
+            r.x = static_cast<std::int16_t>(std::min(std::max(r.x + dx, 0), max_x));
+            r.y = static_cast<std::int16_t>(std::min(std::max(r.y + dy, 0), max_y));
+        }
+    }
+
+    void move_chunks(std::span<NpcHot> records, int max_x, int max_y, std::uint64_t seed, ThreadPool &pool, bool bind)
+    {
+        const size_t chunks = (records.size() + MOVE_CHUNK - 1) / MOVE_CHUNK;
+        parallel_for_on_nodes(pool, chunks, NumaTopology::system(), bind, [&](size_t first, size_t last)
+                              {
+            for (size_t c = first; c < last; ++c)
+                move_range(records.data(), c * MOVE_CHUNK, std::min(records.size(), (c + 1) * MOVE_CHUNK),
+                           max_x, max_y, seed); });
+    }
+}
+
+void move_packed(std::span<NpcHot> records, int max_x, int max_y, std::uint64_t seed)
+{
+    move_range(records.data(), 0, records.size(), max_x, max_y, seed);
+}
+
+void move_packed(std::span<NpcHot> records, int max_x, int max_y, std::uint64_t seed, ThreadPool &pool)
+{
+    move_chunks(records, max_x, max_y, seed, pool, false);
+}
+
+void move_packed(PackedWorld &world, int max_x, int max_y, std::uint64_t seed, ThreadPool &pool)
+{
+    move_chunks(world.records(), max_x, max_y, seed, pool, world.memory_options().pin_threads);
+}
@@ -0,0 +1,109 @@
+#include "../include/neighbours.h"
+
+#include "../include/rules.h"
+
+#include <algorithm>
+#include <cmath>
+
+NeighbourList::NeighbourList(int skin)
+{
+    slack.fill(skin / 2.0);
+}
+
+NeighbourList NeighbourList::for_ticks(size_t ticks)
+{
+    Slack slack;
+    for (size_t type = 0; type < NPC_TYPE_COUNT; ++type)
+        slack[type] = static_cast<double>(ticks) * rules_for(static_cast<NpcType>(type)).step;
+    return NeighbourList(slack);
+}
+
+bool NeighbourList::update(const set_t &npcs, const SpatialIndex &index)
+{
+    if (!needs_rebuild(npcs))
+        return false;
+    rebuild(npcs, index);
+    return true;
+}
+
+bool NeighbourList::needs_rebuild(const set_t &npcs) const
+{
+    if (rebuild_count == 0 || anchors.size() != npcs.size() || layout != npcs.layout_version())
+        return true;
+
+    Slack limit;
+    for (size_t type = 0; type < NPC_TYPE_COUNT; ++type)
+        limit[type] = slack[type] * slack[type];
+    for (size_t i = 0; i < npcs.size(); ++i)
+    {
+        const auto &npc = npcs[i];
+        if (!npc->is_alive())
+            continue;
+        const auto [x, y] = npc->position();
+        const double dx = x - anchors[i].x;
+        const double dy = y - anchors[i].y;
+        if (dx * dx + dy * dy > limit[npc->get_type()])
+            return true;
+    }
+    return false;
+}
+
+void NeighbourList::rebuild(const set_t &npcs, const SpatialIndex &index)
+{
+    std::array<size_t, NPC_TYPE_COUNT> radius{};
+    for (size_t a = 0; a < NPC_TYPE_COUNT; ++a)
+    {
+        double prey_slack = 0.0;
+        for (size_t b = 0; b < NPC_TYPE_COUNT; ++b)
+            if (can_attack(static_cast<NpcType>(a), static_cast<NpcType>(b)))
+                prey_slack = std::max(prey_slack, slack[b]);
+        radius[a] = static_cast<size_t>(
+            std::ceil(rules_for(static_cast<NpcType>(a)).kill_distance + slack[a] + prey_slack));
+    }
+
+    anchors.resize(npcs.size());
+    offsets.assign(npcs.size() + 1, 0);
+    neighbours.clear();
+
+    for (size_t i = 0; i < npcs.size(); ++i)
+    {
+        const auto &npc = npcs[i];
+        const auto [x, y] = npc->position();
+        anchors[i] = {x, y};
+        offsets[i] = static_cast<std::uint32_t>(neighbours.size());
+
+        const NpcType type = npc->get_type();
+        if (!has_prey(type) || !npc->is_alive())
+            continue;
+        index.within_radius(x, y, radius[type], prey_mask(type), hits);
+        for (const auto &hit : hits)
+            neighbours.push_back(static_cast<std::uint32_t>(hit.index));
+    }
+    offsets[npcs.size()] = static_cast<std::uint32_t>(neighbours.size());
+    layout = npcs.layout_version();
+    ++rebuild_count;
+}
+
+void NeighbourList::collect_candidates(const set_t &npcs, std::vector<FightCandidate> &out) const
+{
+    collect_candidates(npcs, out, 0, npcs.size());
+}
+
+void NeighbourList::collect_candidates(const set_t &npcs, std::vector<FightCandidate> &out, size_t begin, size_t end) const
+{
+    const size_t count = offsets.empty() ? 0 : std::min(offsets.size() - 1, npcs.size());
+    for (size_t i = begin; i < end && i < count; ++i)
+    {
+        if (offsets[i] == offsets[i + 1])
+            continue;
+        const auto &attacker = npcs[i];
+        if (!attacker->is_alive())
+            continue;
+        const auto distance = static_cast<size_t>(rules_for(attacker->get_type()).kill_distance);
+        for (std::uint32_t k = offsets[i]; k < offsets[i + 1]; ++k)
+        {
+            if (attacker->is_close(npcs[neighbours[k]], distance))
+                out.push_back({static_cast<std::uint32_t>(i), neighbours[k]});
+        }
+    }
+}
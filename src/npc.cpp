@@ -1,5 +1,8 @@
 #include "../include/npc.h"
 
+#include "../include/format.h"
+#include "../include/npc_store.h"
+
 #include <algorithm>
 #include <mutex>
 #include <random>
@@ -18,6 +21,12 @@ NPC::NPC(NpcType t, std::istream &is) : type(t) // конструктор из 
     is >> y;
 }
 
+void IFightObserver::on_fights(const NpcStore &npcs, std::span<const FightOutcome> outcomes)
+{
+    for (const auto &outcome : outcomes)
+        on_fight(npcs[outcome.attacker], npcs[outcome.defender], outcome.win);
+}
+
 void NPC::subscribe(const std::shared_ptr<IFightObserver> &observer)
 {
     observers.push_back(observer);
@@ -71,8 +80,23 @@ void NPC::move(int shift_x, int shift_y, int max_x, int max_y)
     std::lock_guard<std::shared_mutex> lck(state_mutex);
     if (!alive)
         return;
-    x = std::clamp(x + shift_x, 0, max_x);
-    y = std::clamp(y + shift_y, 0, max_y);
+    const int new_x = std::clamp(x + shift_x, 0, max_x);
+    const int new_y = std::clamp(y + shift_y, 0, max_y);
+    if (new_x == x && new_y == y)
+        return;
+    x = new_x;
+    y = new_y;
+    dirty.store(true, std::memory_order_relaxed);
+}
+
+void NPC::set_position(int x_pos, int y_pos)
+{
+    std::lock_guard<std::shared_mutex> lck(state_mutex);
+    if (x == x_pos && y == y_pos)
+        return;
+    x = x_pos;
+    y = y_pos;
+    dirty.store(true, std::memory_order_relaxed);
 }
 
 bool NPC::is_alive() const
@@ -84,7 +108,10 @@ bool NPC::is_alive() const
 void NPC::die()
 {
     std::lock_guard<std::shared_mutex> lck(state_mutex);
+    if (!alive)
+        return;
     alive = false;
+    dirty.store(true, std::memory_order_relaxed);
 }
 
 void NPC::save(std::ostream &os) const
@@ -93,27 +120,18 @@ void NPC::save(std::ostream &os) const
     os << static_cast<int>(type) << ' ' << name << ' ' << x << ' ' << y << '\n';
 }
 
-namespace
+void NPC::print_to(std::ostream &os) const
 {
-    std::string type_to_string(NpcType t)
-    {
-        switch (t)
-        {
-        case OrkType:
-            return "Ork";
-        case SquirrelType:
-            return "Squirrel";
-        case DruidType:
-            return "Druid";
-        default:
-            return "Unknown";
-        }
-    }
+    auto &buffer = format_scratch();
+    append_npc_line(buffer, *this);
+    flush_buffer(os, buffer);
 }
 
 std::ostream &operator<<(std::ostream &os, NPC &npc)
 {
-    os << type_to_string(npc.type) << ' ' << npc.name << " {" << npc.get_x() << ", " << npc.get_y() << "}";
+    auto &buffer = format_scratch();
+    append_npc(buffer, npc);
+    flush_buffer(os, buffer);
     return os;
 }
 
@@ -128,6 +146,11 @@ int roll_dice()
     return dice_dist(rng);
 }
 
+std::uint64_t draw_seed()
+{
+    return (static_cast<std::uint64_t>(rng()) << 32) | rng();
+}
+
 void seed_random(unsigned int seed)
 {
     rng.seed(seed);
@@ -0,0 +1,136 @@
+#include "../include/npc_store.h"
+
+std::pair<NpcId, bool> NpcStore::insert(const value_type &npc)
+{
+    if (!npc)
+        return {NpcId{}, false};
+
+    if (auto it = by_pointer.find(npc.get()); it != by_pointer.end())
+        return {NpcId{it->second, slots[it->second].generation}, false};
+
+    std::uint32_t slot_index;
+    if (free_head != NpcId::invalid_index)
+    {
+        slot_index = free_head;
+        free_head = slots[slot_index].dense;
+    }
+    else
+    {
+        slot_index = static_cast<std::uint32_t>(slots.size());
+        slots.emplace_back();
+    }
+
+    Slot &slot = slots[slot_index];
+    slot.dense = static_cast<std::uint32_t>(items.size());
+    slot.used = true;
+    items.push_back(npc);
+    slot_of_dense.push_back(slot_index);
+    by_pointer.emplace(npc.get(), slot_index);
+    return {NpcId{slot_index, slot.generation}, true};
+}
+
+bool NpcStore::erase(NpcId id)
+{
+    if (!contains(id))
+        return false;
+
+    Slot &slot = slots[id.index];
+    const std::uint32_t hole = slot.dense;
+    const std::uint32_t last = static_cast<std::uint32_t>(items.size() - 1);
+
+    by_pointer.erase(items[hole].get());
+    if (hole != last)
+    {
+        items[hole] = std::move(items[last]);
+        slot_of_dense[hole] = slot_of_dense[last];
+        slots[slot_of_dense[hole]].dense = hole;
+    }
+    items.pop_back();
+    slot_of_dense.pop_back();
+    ++version;
+
+    slot.used = false;
+    ++slot.generation;
+    slot.dense = free_head;
+    free_head = id.index;
+    return true;
+}
+
+size_t NpcStore::erase(const value_type &npc)
+{
+    return erase(id_of(npc)) ? 1 : 0;
+}
+
+void NpcStore::clear()
+{
+    while (!items.empty())
+        erase(id_at(items.size() - 1));
+}
+
+void NpcStore::reserve(size_t n)
+{
+    items.reserve(n);
+    slot_of_dense.reserve(n);
+    slots.reserve(n);
+    by_pointer.reserve(n);
+}
+
+void NpcStore::permute(const std::vector<size_t> &order)
+{
+    if (order.size() != items.size())
+        return;
+
+    std::vector<value_type> reordered_items;
+    std::vector<std::uint32_t> reordered_slots;
+    reordered_items.reserve(items.size());
+    reordered_slots.reserve(items.size());
+    for (size_t k = 0; k < order.size(); ++k)
+    {
+        reordered_items.push_back(std::move(items[order[k]]));
+        reordered_slots.push_back(slot_of_dense[order[k]]);
+        slots[reordered_slots.back()].dense = static_cast<std::uint32_t>(k);
+    }
+    items = std::move(reordered_items);
+    slot_of_dense = std::move(reordered_slots);
+    ++version;
+}
+
+NpcStore::value_type NpcStore::get(NpcId id) const
+{
+    if (!contains(id))
+        return nullptr;
+    return items[slots[id.index].dense];
+}
+
+bool NpcStore::contains(NpcId id) const
+{
+    return id.index < slots.size() && slots[id.index].used && slots[id.index].generation == id.generation;
+}
+
+bool NpcStore::contains(const value_type &npc) const
+{
+    return npc && by_pointer.count(npc.get()) != 0;
+}
+
+NpcId NpcStore::id_of(const value_type &npc) const
+{
+    if (!npc)
+        return NpcId{};
+    auto it = by_pointer.find(npc.get());
+    if (it == by_pointer.end())
+        return NpcId{};
+    return NpcId{it->second, slots[it->second].generation};
+}
+
+NpcId NpcStore::id_at(size_t dense_index) const
+{
+    const std::uint32_t slot_index = slot_of_dense[dense_index];
+    return NpcId{slot_index, slots[slot_index].generation};
+}
+
+size_t NpcStore::dense_index(NpcId id) const
+{
+    if (!contains(id))
+        return items.size();
+    return slots[id.index].dense;
+}
@@ -1,5 +1,9 @@
 #include "../include/observers.h"
 
+#include "../include/format.h"
+#include "../include/npc_store.h"
+#include "../include/trace.h"
+
 #include <iostream>
 #include <mutex>
 
@@ -9,14 +13,34 @@ void ConsoleObserver::on_fight(const std::shared_ptr<NPC> attacker,
 {
     if (win && attacker && defender)
     {
+        auto &buffer = format_scratch();
+        buffer.append("\nMurder --------\n");
+        append_npc_line(buffer, *attacker);
+        append_npc_line(buffer, *defender);
         std::lock_guard<std::mutex> lck(console_mutex());
-        std::cout << std::endl
-                  << "Murder --------" << std::endl;
-        attacker->print();
-        defender->print();
+        flush_buffer(std::cout, buffer);
     }
 }
 
+void ConsoleObserver::on_fights(const NpcStore &npcs, std::span<const FightOutcome> outcomes)
+{
+    TRACE_SCOPE("ConsoleObserver::on_fights");
+    auto &buffer = format_scratch();
+    for (const auto &outcome : outcomes)
+    {
+        if (!outcome.win)
+            continue;
+        buffer.append("\nMurder --------\n");
+        append_npc_line(buffer, *npcs[outcome.attacker]);
+        append_npc_line(buffer, *npcs[outcome.defender]);
+    }
+    if (buffer.empty())
+        return;
+    TRACE_SCOPE("console_mutex");
+    std::lock_guard<std::mutex> lck(console_mutex());
+    flush_buffer(std::cout, buffer);
+}
+
 FileObserver::FileObserver(const std::string &path) : out(path, std::ios::trunc) {}
 
 void FileObserver::on_fight(const std::shared_ptr<NPC> attacker,
@@ -30,3 +54,139 @@ void FileObserver::on_fight(const std::shared_ptr<NPC> attacker,
         out.flush();
     }
 }
+
+void FileObserver::on_fights(const NpcStore &npcs, std::span<const FightOutcome> outcomes)
+{
+    TRACE_SCOPE("FileObserver::on_fights");
+    if (!out)
+        return;
+    auto &buffer = format_scratch();
+    for (const auto &outcome : outcomes)
+    {
+        if (!outcome.win)
+            continue;
+        buffer.append("Kill: ");
+        append_npc(buffer, *npcs[outcome.attacker]);
+        buffer.append(" -> ");
+        append_npc(buffer, *npcs[outcome.defender]);
+        buffer.push_back('\n');
+    }
+    if (buffer.empty())
+        return;
+    std::lock_guard<std::mutex> lck(mtx);
+    flush_buffer(out, buffer);
+    out.flush();
+}
+
+SummaryConsoleObserver::SummaryConsoleObserver(ConsoleSummaryOptions opts) : options(opts)
+{
+    pending.samples.reserve(options.samples_per_interval);
+    printer = std::thread([this]()
+                          { printer_loop(); });
+}
+
+SummaryConsoleObserver::~SummaryConsoleObserver()
+{
+    {
+        std::lock_guard<std::mutex> lck(mtx);
+        stopped = true;
+    }
+    cv.notify_all();
+    printer.join();
+    flush();
+}
+
+void SummaryConsoleObserver::on_fight(const std::shared_ptr<NPC> attacker,
+                                      const std::shared_ptr<NPC> defender,
+                                      bool win)
+{
+    if (!win || !attacker || !defender)
+        return;
+    std::lock_guard<std::mutex> lck(mtx);
+    record(*attacker, *defender);
+}
+
+void SummaryConsoleObserver::on_fights(const NpcStore &npcs, std::span<const FightOutcome> outcomes)
+{
+    TRACE_SCOPE("SummaryConsoleObserver::on_fights");
+    std::lock_guard<std::mutex> lck(mtx);
+    for (const auto &outcome : outcomes)
+    {
+        if (outcome.win)
+            record(*npcs[outcome.attacker], *npcs[outcome.defender]);
+    }
+}
+
+void SummaryConsoleObserver::record(const NPC &attacker, const NPC &defender)
+{
+    ++pending.kills[attacker.get_type()][defender.get_type()];
+    ++pending.total;
+    if (pending.samples.size() < options.samples_per_interval)
+    {
+        std::string sample;
+        append_npc(sample, attacker);
+        sample.append(" -> ");
+        append_npc(sample, defender);
+        pending.samples.push_back(std::move(sample));
+    }
+}
+
+void SummaryConsoleObserver::flush()
+{
+    Interval ready;
+    ready.samples.reserve(options.samples_per_interval);
+    {
+        std::lock_guard<std::mutex> lck(mtx);
+        std::swap(ready, pending);
+    }
+    print(ready);
+}
+
+void SummaryConsoleObserver::print(const Interval &interval) const
+{
+    if (interval.total == 0 || !options.out)
+        return;
+
+    std::string text = "\nMurders: " + std::to_string(interval.total) + '\n';
+    for (size_t a = 0; a < NPC_TYPE_COUNT; ++a)
+    {
+        for (size_t d = 0; d < NPC_TYPE_COUNT; ++d)
+        {
+            if (interval.kills[a][d] == 0)
+                continue;
+            text.append("  ");
+            text.append(type_name(static_cast<NpcType>(a)));
+            text.append(" -> ");
+            text.append(type_name(static_cast<NpcType>(d)));
+            text.append(": ");
+            text.append(std::to_string(interval.kills[a][d]));
+            text.push_back('\n');
+        }
+    }
+    for (const auto &sample : interval.samples)
+    {
+        text.append("  e.g. ");
+        text.append(sample);
+        text.push_back('\n');
+    }
+
+    TRACE_SCOPE("console_mutex");
+    std::lock_guard<std::mutex> lck(console_mutex());
+    flush_buffer(*options.out, text);
+}
+
+void SummaryConsoleObserver::printer_loop()
+{
+    trace_thread_name("summary_printer");
+    std::unique_lock<std::mutex> lck(mtx);
+    while (!stopped)
+    {
+        cv.wait_for(lck, options.interval, [&]()
+                    { return stopped; });
+        if (stopped)
+            break;
+        lck.unlock();
+        flush();
+        lck.lock();
+    }
+}
@@ -39,7 +39,7 @@ bool Ork::fight(const std::shared_ptr<Druid> &other)
 
 void Ork::print() const
 {
-    std::cout << "Ork " << name << " (" << get_x() << ", " << get_y() << ")" << std::endl;
+    print_to(std::cout);
 }
 
 void Ork::save(std::ostream &os) const
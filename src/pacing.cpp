@@ -0,0 +1,99 @@
+#include "../include/pacing.h"
+
+#include <algorithm>
+#include <thread>
+
+namespace
+{
+    constexpr size_t HISTORY_SIZE = 1024;
+
+    std::chrono::microseconds to_us(TickPacer::clock::duration d)
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds>(d);
+    }
+}
+
+TickPacer::TickPacer(clock::duration tick_period, double detection_share, size_t max_detection_slices)
+    : period(tick_period),
+      detection_budget(std::chrono::duration_cast<clock::duration>(tick_period * detection_share)),
+      max_slices(std::max<size_t>(1, max_detection_slices))
+{
+    history.reserve(HISTORY_SIZE);
+}
+
+void TickPacer::begin_tick()
+{
+    tick_start = clock::now();
+    if (!started)
+    {
+        deadline = tick_start;
+        started = true;
+    }
+}
+
+std::pair<size_t, size_t> TickPacer::detection_slice(size_t total)
+{
+    detection_start = clock::now();
+    cursor %= slices;
+    const size_t begin = total * cursor / slices;
+    const size_t end = total * (cursor + 1) / slices;
+    ++cursor;
+    return {begin, end};
+}
+
+void TickPacer::end_detection()
+{
+    const auto spent = clock::now() - detection_start;
+    // Время полного прохода ~ spent * slices; делим сильнее при перерасходе и собираем
+    // обратно, когда запас большой.
+    if (spent > detection_budget && slices < max_slices)
+    {
+        slices = std::min(max_slices, slices * 2);
+        cursor = 0;
+    }
+    else if (slices > 1 && spent * 4 < detection_budget)
+    {
+        slices /= 2;
+        cursor = 0;
+    }
+}
+
+void TickPacer::finish_tick()
+{
+    const auto spent = clock::now() - tick_start;
+    if (history.size() < HISTORY_SIZE)
+        history.push_back(spent);
+    else
+        history[history_next] = spent;
+    history_next = (history_next + 1) % HISTORY_SIZE;
+    ++ticks;
+    if (spent > period)
+        ++overruns;
+}
+
+void TickPacer::end_tick()
+{
+    finish_tick();
+    deadline += period;
+    const auto now = clock::now();
+    if (deadline < now)
+        deadline = now; // после перерасхода не догоняем пачкой тиков
+    std::this_thread::sleep_until(deadline);
+}
+
+TickStats TickPacer::stats() const
+{
+    TickStats result;
+    result.ticks = ticks;
+    result.overruns = overruns;
+    result.detection_slices = slices;
+    if (history.empty())
+        return result;
+
+    auto sorted = history;
+    std::sort(sorted.begin(), sorted.end());
+    result.p50 = to_us(sorted[(sorted.size() - 1) / 2]);
+    result.p99 = to_us(sorted[(sorted.size() - 1) * 99 / 100]);
+    result.max = to_us(sorted.back());
+    return result;
+}
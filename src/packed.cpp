@@ -0,0 +1,191 @@
+#include "../include/packed.h"
+
+#include <algorithm>
+#include <iostream>
+
+PackedWorld::PackedWorld(const WorldMemoryOptions &options)
+    : options(options), hot(PlacedAllocator<NpcHot>(options.huge_pages))
+{
+}
+
+bool PackedWorld::add(NpcType type, std::string_view name, int x, int y, std::uint16_t generation)
+{
+    if (x < MIN_COORD || x > MAX_COORD || y < MIN_COORD || y > MAX_COORD || name.size() > MAX_NAME)
+        return false;
+    if (hot.size() % NAME_BLOCK == 0)
+        name_blocks.push_back(static_cast<std::uint32_t>(names.size()));
+    hot.push_back({static_cast<std::int16_t>(x), static_cast<std::int16_t>(y),
+                   static_cast<std::uint8_t>((type & NpcHot::TYPE_MASK) | NpcHot::ALIVE_BIT), 0, generation});
+    names.append(name);
+    name_lengths.push_back(static_cast<std::uint8_t>(name.size()));
+    return true;
+}
+
+void PackedWorld::reserve(size_t count, size_t name_bytes)
+{
+    hot.reserve(count);
+    name_lengths.reserve(count);
+    name_blocks.reserve((count + NAME_BLOCK - 1) / NAME_BLOCK);
+    names.reserve(name_bytes);
+}
+
+void PackedWorld::clear()
+{
+    hot.clear();
+    name_lengths.clear();
+    name_blocks.clear();
+    names.clear();
+}
+
+std::string_view PackedWorld::name(std::uint32_t index) const
+{
+    // Имена читают редко (вывод, сохранение), поэтому смещение досчитывается от начала блока.
+    size_t offset = name_blocks[index / NAME_BLOCK];
+    for (size_t i = index - index % NAME_BLOCK; i < index; ++i)
+        offset += name_lengths[i];
+    return std::string_view(names).substr(offset, name_lengths[index]);
+}
+
+size_t PackedWorld::memory_bytes() const noexcept
+{
+    return hot.capacity() * sizeof(NpcHot) + name_lengths.capacity() + name_blocks.capacity() * sizeof(std::uint32_t) +
+           names.capacity();
+}
+
+std::optional<PackedWorld> PackedWorld::from_store(const set_t &npcs)
+{
+    PackedWorld world;
+    size_t name_bytes = 0;
+    for (const auto &npc : npcs)
+        name_bytes += npc->get_name().size();
+    world.reserve(npcs.size(), name_bytes);
+
+    for (size_t i = 0; i < npcs.size(); ++i)
+    {
+        const auto &npc = npcs[i];
+        const auto [x, y] = npc->position();
+        if (!world.add(npc->get_type(), npc->get_name(), x, y, static_cast<std::uint16_t>(npcs.id_at(i).generation)))
+        {
+            std::cerr << "PackedWorld: " << npc->get_name() << " at {" << x << ", " << y
+                      << "} does not fit int16 coordinates or the name limit" << std::endl;
+            return std::nullopt;
+        }
+        if (!npc->is_alive())
+            world.kill(static_cast<std::uint32_t>(i));
+    }
+    return world;
+}
+
+std::optional<PackedWorld> PackedWorld::from_store(const set_t &npcs, const WorldMemoryOptions &options, ThreadPool &pool)
+{
+    auto plain = from_store(npcs);
+    if (!plain)
+        return std::nullopt;
+    PackedWorld world(options);
+    world.hot.assign(plain->hot.begin(), plain->hot.end());
+    world.name_lengths = std::move(plain->name_lengths);
+    world.name_blocks = std::move(plain->name_blocks);
+    world.names = std::move(plain->names);
+    if (options.first_touch)
+        world.place(pool);
+    return world;
+}
+
+void PackedWorld::place(ThreadPool &pool, const NumaTopology &topology)
+{
+    placed_vector<NpcHot> placed(hot.get_allocator());
+    placed.reserve(hot.capacity());
+    placed.resize(hot.size()); // без инициализации: страницы ещё не тронуты
+    parallel_for_on_nodes(pool, hot.size(), topology, true, [&](size_t begin, size_t end)
+                          { std::copy(hot.begin() + begin, hot.begin() + end, placed.begin() + begin); });
+    hot.swap(placed);
+}
+
+void PackedWorld::apply_to(const set_t &npcs) const
+{
+    const size_t count = std::min(npcs.size(), hot.size());
+    for (size_t i = 0; i < count; ++i)
+    {
+        const auto &npc = npcs[i];
+        npc->set_position(hot[i].x, hot[i].y);
+        if (!hot[i].alive())
+            npc->die();
+    }
+}
+
+PackedFightScratch::PackedFightScratch(HugePages huge_pages)
+    : candidates(PlacedAllocator<FightCandidate>(huge_pages)), attack(PlacedAllocator<std::uint8_t>(huge_pages)),
+      defense(PlacedAllocator<std::uint8_t>(huge_pages))
+{
+    for (auto &bucket : buckets)
+        bucket = placed_vector<Entry>(PlacedAllocator<Entry>(huge_pages));
+}
+
+void fight_packed(PackedWorld &world, size_t distance, std::uint64_t seed, std::vector<FightOutcome> &out)
+{
+    PackedFightScratch scratch;
+    fight_packed(world, distance, seed, out, scratch);
+}
+
+void fight_packed(PackedWorld &world, size_t distance, std::uint64_t seed, std::vector<FightOutcome> &out,
+                  PackedFightScratch &scratch)
+{
+    using PackedEntry = PackedFightScratch::Entry;
+    out.clear();
+    const auto records = world.records();
+
+    auto &buckets = scratch.buckets;
+    for (auto &bucket : buckets)
+        bucket.clear();
+    for (std::uint32_t i = 0; i < records.size(); ++i)
+    {
+        if (records[i].alive() && records[i].type() < NPC_TYPE_COUNT)
+            buckets[records[i].type()].push_back({records[i].x, i});
+    }
+    for (auto &bucket : buckets)
+        std::sort(bucket.begin(), bucket.end(), [](const PackedEntry &a, const PackedEntry &b)
+                  { return a.x < b.x || (a.x == b.x && a.index < b.index); });
+
+    const auto reach = static_cast<long long>(distance);
+    const long long reach2 = reach * reach;
+    auto &candidates = scratch.candidates;
+    candidates.clear();
+    for (std::uint32_t i = 0; i < records.size(); ++i)
+    {
+        const NpcHot attacker = records[i];
+        if (!attacker.alive() || !has_prey(attacker.type()))
+            continue;
+        for (size_t t = 0; t < NPC_TYPE_COUNT; ++t)
+        {
+            if (!can_attack(attacker.type(), static_cast<NpcType>(t)))
+                continue;
+            const auto &bucket = buckets[t];
+            auto it = std::lower_bound(bucket.begin(), bucket.end(), attacker.x - reach,
+                                       [](const PackedEntry &e, long long value)
+                                       { return e.x < value; });
+            for (; it != bucket.end() && it->x <= attacker.x + reach; ++it)
+            {
+                const long long dx = attacker.x - records[it->index].x;
+                const long long dy = attacker.y - records[it->index].y;
+                if (dx * dx + dy * dy <= reach2)
+                    candidates.push_back({i, it->index});
+            }
+        }
+    }
+
+    auto &attack = scratch.attack;
+    auto &defense = scratch.defense;
+    attack.resize(candidates.size());
+    defense.resize(candidates.size());
+    roll_dice_batch(seed, attack, defense);
+    for (size_t k = 0; k < candidates.size(); ++k)
+    {
+        const auto [a, d] = candidates[k];
+        if (!records[a].alive() || !records[d].alive())
+            continue;
+        const bool win = attack[k] > defense[k];
+        if (win)
+            world.kill(d);
+        out.push_back({a, d, win});
+    }
+}
@@ -0,0 +1,207 @@
+#include "../include/partition.h"
+
+#include "../include/rules.h"
+
+#include <algorithm>
+#include <atomic>
+#include <limits>
+
+AdaptivePartitioner::AdaptivePartitioner(size_t tiles, size_t every)
+    : target_tiles(std::max<size_t>(1, tiles)), rebalance_every(std::max<size_t>(1, every))
+{
+}
+
+std::span<const std::uint32_t> AdaptivePartitioner::members(size_t tile) const
+{
+    return std::span<const std::uint32_t>(order).subspan(offsets[tile], offsets[tile + 1] - offsets[tile]);
+}
+
+void AdaptivePartitioner::record(size_t tile, std::chrono::nanoseconds cost)
+{
+    std::atomic_ref<std::chrono::nanoseconds::rep>(window[tile]).fetch_add(cost.count(), std::memory_order_relaxed);
+}
+
+size_t AdaptivePartitioner::locate(int x, int y) const
+{
+    std::int32_t node = root;
+    while (node >= 0)
+    {
+        const Split &s = splits[node];
+        node = (s.vertical ? x : y) < s.value ? s.left : s.right;
+    }
+    return static_cast<size_t>(~node);
+}
+
+void AdaptivePartitioner::assign(const set_t &npcs)
+{
+    if (leaves.empty())
+        build(npcs, {});
+
+    tile_of.assign(npcs.size(), std::numeric_limits<std::uint32_t>::max());
+    offsets.assign(leaves.size() + 1, 0);
+    for (size_t i = 0; i < npcs.size(); ++i)
+    {
+        const auto &npc = npcs[i];
+        if (!npc->is_alive())
+            continue;
+        const auto [x, y] = npc->position();
+        const auto t = static_cast<std::uint32_t>(locate(x, y));
+        tile_of[i] = t;
+        ++offsets[t + 1];
+    }
+    for (size_t t = 0; t < leaves.size(); ++t)
+        offsets[t + 1] += offsets[t];
+
+    order.resize(offsets.back());
+    std::vector<std::uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < tile_of.size(); ++i)
+        if (tile_of[i] != std::numeric_limits<std::uint32_t>::max())
+            order[cursor[tile_of[i]]++] = static_cast<std::uint32_t>(i);
+}
+
+bool AdaptivePartitioner::end_tick(const set_t &npcs)
+{
+    if (++tick % rebalance_every != 0)
+        return false;
+
+    double total = 0.0;
+    double worst = 0.0;
+    for (const auto cost : window)
+    {
+        total += static_cast<double>(cost);
+        worst = std::max(worst, static_cast<double>(cost));
+    }
+    if (total <= 0.0)
+        return false;
+    last_imbalance = worst * static_cast<double>(window.size()) / total;
+
+    // Вес NPC — средняя стоимость одного NPC его плитки в закрытом окне.
+    std::vector<double> per_member(leaves.size(), 0.0);
+    for (size_t t = 0; t < leaves.size(); ++t)
+    {
+        const size_t count = offsets[t + 1] - offsets[t];
+        if (count != 0)
+            per_member[t] = static_cast<double>(window[t]) / static_cast<double>(count);
+    }
+    std::vector<double> weights(npcs.size(), 0.0);
+    for (size_t i = 0; i < npcs.size() && i < tile_of.size(); ++i)
+        if (tile_of[i] != std::numeric_limits<std::uint32_t>::max())
+            weights[i] = per_member[tile_of[i]];
+
+    build(npcs, weights);
+    ++rebalance_count;
+    return true;
+}
+
+void AdaptivePartitioner::build(const set_t &npcs, const std::vector<double> &weights)
+{
+    std::vector<Point> points;
+    points.reserve(npcs.size());
+    int min_x = 0, min_y = 0, max_x = 0, max_y = 0;
+    for (size_t i = 0; i < npcs.size(); ++i)
+    {
+        const auto &npc = npcs[i];
+        if (!npc->is_alive())
+            continue;
+        const auto [x, y] = npc->position();
+        // Плитка без замеров (новый NPC или пустая плитка) получает минимальный вес, но не ноль.
+        const double w = i < weights.size() && weights[i] > 0.0 ? weights[i] : 1.0;
+        if (points.empty())
+        {
+            min_x = max_x = x;
+            min_y = max_y = y;
+        }
+        min_x = std::min(min_x, x);
+        max_x = std::max(max_x, x);
+        min_y = std::min(min_y, y);
+        max_y = std::max(max_y, y);
+        points.push_back({x, y, w});
+    }
+
+    splits.clear();
+    leaves.clear();
+    root = build_node(points, 0, points.size(), target_tiles, {min_x, min_y, max_x + 1, max_y + 1});
+    window.assign(leaves.size(), 0);
+}
+
+std::int32_t AdaptivePartitioner::build_node(std::vector<Point> &points, size_t begin, size_t end, size_t tiles,
+                                            Tile bounds)
+{
+    if (tiles <= 1 || end - begin < 2)
+    {
+        leaves.push_back(bounds);
+        return ~static_cast<std::int32_t>(leaves.size() - 1);
+    }
+
+    const bool vertical = bounds.x1 - bounds.x0 >= bounds.y1 - bounds.y0;
+    const auto key = [vertical](const Point &p)
+    { return vertical ? p.x : p.y; };
+    std::sort(points.begin() + begin, points.begin() + end, [&](const Point &a, const Point &b)
+              { return key(a) < key(b); });
+
+    // Левой половине — доля веса, пропорциональная числу её плиток.
+    const size_t left_tiles = tiles / 2;
+    double total = 0.0;
+    for (size_t i = begin; i < end; ++i)
+        total += points[i].weight;
+    const double target = total * static_cast<double>(left_tiles) / static_cast<double>(tiles);
+
+    size_t mid = begin;
+    double acc = 0.0;
+    while (mid < end - 1 && acc + points[mid].weight <= target)
+        acc += points[mid++].weight;
+    // Все точки с одной координатой должны попасть на одну сторону.
+    const int value = key(points[std::max(mid, begin + 1)]);
+    mid = static_cast<size_t>(std::lower_bound(points.begin() + begin, points.begin() + end, value,
+                                               [&](const Point &p, int v)
+                                               { return key(p) < v; }) -
+                              points.begin());
+
+    Tile left_bounds = bounds;
+    Tile right_bounds = bounds;
+    (vertical ? left_bounds.x1 : left_bounds.y1) = value;
+    (vertical ? right_bounds.x0 : right_bounds.y0) = value;
+
+    const auto node = static_cast<std::int32_t>(splits.size());
+    splits.push_back({vertical, value, -1, -1});
+    const auto left = build_node(points, begin, mid, left_tiles, left_bounds);
+    const auto right = build_node(points, mid, end, tiles - left_tiles, right_bounds);
+    splits[node].left = left;
+    splits[node].right = right;
+    return node;
+}
+
+void collect_candidates_tiled(const set_t &npcs, const SpatialIndex &index, AdaptivePartitioner &partition,
+                              ThreadPool &pool, std::vector<FightCandidate> &out)
+{
+    partition.assign(npcs);
+    const size_t tiles = partition.tile_count();
+    std::vector<std::vector<FightCandidate>> partial(tiles);
+    pool.parallel_for(tiles, [&](size_t first, size_t last)
+                      {
+        std::vector<SpatialHit> hits;
+        for (size_t t = first; t < last; ++t)
+        {
+            const auto start = std::chrono::steady_clock::now();
+            for (const auto i : partition.members(t))
+            {
+                const auto &npc = npcs[i];
+                const NpcType type = npc->get_type();
+                if (!has_prey(type))
+                    continue;
+                const auto [x, y] = npc->position();
+                index.within_radius(x, y, static_cast<size_t>(rules_for(type).kill_distance), prey_mask(type), hits);
+                for (const auto &hit : hits)
+                    if (npcs[hit.index]->is_alive())
+                        partial[t].push_back({i, static_cast<std::uint32_t>(hit.index)});
+            }
+            partition.record(t, std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                    std::chrono::steady_clock::now() - start));
+        } });
+
+    out.clear();
+    for (const auto &part : partial)
+        out.insert(out.end(), part.begin(), part.end());
+    std::sort(out.begin(), out.end(), [](const FightCandidate &a, const FightCandidate &b)
+              { return a.attacker < b.attacker || (a.attacker == b.attacker && a.defender < b.defender); });
+}
@@ -0,0 +1,173 @@
+#include "../include/placement.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <pthread.h>
+#include <string>
+#include <sys/mman.h>
+#include <thread>
+
+namespace
+{
+    constexpr size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+    // Меньшие блоки не стоят отдельного mmap.
+    constexpr size_t MMAP_THRESHOLD = 64 * 1024;
+
+    bool uses_mmap(size_t bytes, HugePages mode)
+    {
+        return mode != HugePages::Off && bytes >= MMAP_THRESHOLD;
+    }
+
+    size_t round_to_huge(size_t bytes)
+    {
+        return (bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+    }
+
+    // Формат cpulist: "0-3,8,10-11".
+    std::vector<unsigned> parse_cpulist(const std::string &text)
+    {
+        std::vector<unsigned> cpus;
+        const char *p = text.data();
+        const char *end = p + text.size();
+        while (p < end)
+        {
+            unsigned first = 0;
+            auto [next, ec] = std::from_chars(p, end, first);
+            if (ec != std::errc())
+                break;
+            unsigned last = first;
+            if (next < end && *next == '-')
+            {
+                auto [after, ec2] = std::from_chars(next + 1, end, last);
+                if (ec2 != std::errc())
+                    break;
+                next = after;
+            }
+            for (unsigned cpu = first; cpu <= last; ++cpu)
+                cpus.push_back(cpu);
+            p = next;
+            if (p < end && *p == ',')
+                ++p;
+            else
+                break;
+        }
+        return cpus;
+    }
+
+    std::vector<std::vector<unsigned>> read_topology()
+    {
+        std::vector<std::pair<unsigned, std::vector<unsigned>>> found;
+        std::error_code ec;
+        for (const auto &entry : std::filesystem::directory_iterator("/sys/devices/system/node", ec))
+        {
+            const std::string name = entry.path().filename().string();
+            unsigned node = 0;
+            if (name.rfind("node", 0) != 0 ||
+                std::from_chars(name.data() + 4, name.data() + name.size(), node).ec != std::errc())
+                continue;
+            std::ifstream in(entry.path() / "cpulist");
+            std::string line;
+            std::getline(in, line);
+            auto cpus = parse_cpulist(line);
+            // Узлы только с памятью потоки не обслуживают.
+            if (!cpus.empty())
+                found.emplace_back(node, std::move(cpus));
+        }
+        std::sort(found.begin(), found.end());
+
+        std::vector<std::vector<unsigned>> nodes;
+        for (auto &[node, cpus] : found)
+            nodes.push_back(std::move(cpus));
+        if (nodes.empty())
+        {
+            std::vector<unsigned> all(std::max(1u, std::thread::hardware_concurrency()));
+            for (unsigned cpu = 0; cpu < all.size(); ++cpu)
+                all[cpu] = cpu;
+            nodes.push_back(std::move(all));
+        }
+        return nodes;
+    }
+}
+
+NumaTopology::NumaTopology(std::vector<std::vector<unsigned>> node_cpus) : node_cpus(std::move(node_cpus))
+{
+    if (this->node_cpus.empty())
+        this->node_cpus.push_back({0});
+}
+
+const NumaTopology &NumaTopology::system()
+{
+    static const NumaTopology topology(read_topology());
+    return topology;
+}
+
+size_t NumaTopology::node_of(size_t index, size_t count) const noexcept
+{
+    if (count == 0)
+        return 0;
+    return std::min(nodes() - 1, index * nodes() / count);
+}
+
+NodeBinding::NodeBinding(const NumaTopology &topology, size_t node)
+{
+    if (!topology.multi_node())
+        return;
+    if (pthread_getaffinity_np(pthread_self(), sizeof(previous), &previous) != 0)
+        return;
+    cpu_set_t target;
+    CPU_ZERO(&target);
+    for (unsigned cpu : topology.cpus(node))
+        if (cpu < CPU_SETSIZE)
+            CPU_SET(cpu, &target);
+    restore = pthread_setaffinity_np(pthread_self(), sizeof(target), &target) == 0;
+}
+
+NodeBinding::~NodeBinding()
+{
+    if (restore)
+        pthread_setaffinity_np(pthread_self(), sizeof(previous), &previous);
+}
+
+void *placed_allocate(size_t bytes, HugePages mode)
+{
+    if (!uses_mmap(bytes, mode))
+        return ::operator new(bytes);
+
+    const size_t length = round_to_huge(bytes);
+    void *data = MAP_FAILED;
+    if (mode == HugePages::Explicit)
+        data = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (data == MAP_FAILED)
+    {
+        // Запас под выравнивание начала на границу huge-страницы.
+        const size_t padded = length + HUGE_PAGE_SIZE;
+        void *raw = mmap(nullptr, padded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (raw == MAP_FAILED)
+            throw std::bad_alloc();
+        const auto base = reinterpret_cast<std::uintptr_t>(raw);
+        const auto aligned = (base + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+        if (aligned > base)
+            munmap(raw, aligned - base);
+        const size_t tail = base + padded - (aligned + length);
+        if (tail > 0)
+            munmap(reinterpret_cast<void *>(aligned + length), tail);
+        data = reinterpret_cast<void *>(aligned);
+        madvise(data, length, MADV_HUGEPAGE);
+    }
+    return data;
+}
+
+void placed_free(void *data, size_t bytes, HugePages mode) noexcept
+{
+    if (!data)
+        return;
+    if (!uses_mmap(bytes, mode))
+    {
+        ::operator delete(data);
+        return;
+    }
+    munmap(data, round_to_huge(bytes));
+}
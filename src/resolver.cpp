@@ -0,0 +1,114 @@
+#include "../include/resolver.h"
+
+namespace
+{
+    std::uint8_t d6(std::uint64_t bits32)
+    {
+        return static_cast<std::uint8_t>(1 + ((bits32 * 6) >> 32));
+    }
+}
+
+void roll_dice_batch(std::uint64_t seed, std::span<std::uint8_t> attack, std::span<std::uint8_t> defense)
+{
+    const size_t n = attack.size() < defense.size() ? attack.size() : defense.size();
+    for (size_t i = 0; i < n; ++i)
+    {
+        const std::uint64_t bits = counter_bits(seed, i);
+        attack[i] = d6(bits & 0xFFFFFFFFull);
+        defense[i] = d6(bits >> 32);
+    }
+}
+
+void FightResolver::resolve(const NpcStore &npcs, std::span<const FightCandidate> candidates, std::uint64_t seed)
+{
+    results.clear();
+    if (layout != npcs.layout_version())
+    {
+        dead.clear();
+        layout = npcs.layout_version();
+    }
+    if (dead.size() < npcs.size())
+        dead.resize(npcs.size(), 0);
+    results.reserve(candidates.size());
+    attack.resize(candidates.size());
+    defense.resize(candidates.size());
+    roll_dice_batch(seed, attack, defense);
+
+    for (size_t i = 0; i < candidates.size(); ++i)
+    {
+        const auto [a, d] = candidates[i];
+        if (a >= npcs.size() || d >= npcs.size() || dead[a] || dead[d])
+            continue;
+        const bool win = attack[i] > defense[i];
+        dead[d] = win;
+        results.push_back({a, d, win});
+    }
+
+    for (const auto &outcome : results)
+    {
+        if (outcome.win)
+            npcs[outcome.defender]->die();
+    }
+}
+
+void FightResolver::reset()
+{
+    dead.clear();
+}
+
+void FightResolver::notify(const NpcStore &npcs) const
+{
+    const std::span<const FightOutcome> all(results);
+    size_t begin = 0;
+    while (begin < all.size())
+    {
+        // Подряд идущие исходы с одинаковым набором наблюдателей уходят одним span.
+        const auto &observers = npcs[all[begin].attacker]->get_observers();
+        size_t end = begin + 1;
+        while (end < all.size() && npcs[all[end].attacker]->get_observers() == observers)
+            ++end;
+        for (const auto &observer : observers)
+            observer->on_fights(npcs, all.subspan(begin, end - begin));
+        begin = end;
+    }
+}
+
+void AttackCooldowns::advance_to(std::uint64_t now)
+{
+    wheel.advance_to(now, [this](TimerId, std::uint64_t payload)
+                     {
+        const auto index = static_cast<std::uint32_t>(payload);
+        const auto generation = static_cast<std::uint32_t>(payload >> 32);
+        if (index < rest.size() && rest[index].generation == generation)
+            rest[index].on = false; });
+}
+
+bool AttackCooldowns::resting(NpcId id) const noexcept
+{
+    return id.index < rest.size() && rest[id.index].on && rest[id.index].generation == id.generation;
+}
+
+void AttackCooldowns::filter(const NpcStore &npcs, std::vector<FightCandidate> &candidates) const
+{
+    if (wheel.size() == 0)
+        return;
+    std::erase_if(candidates, [&](const FightCandidate &c)
+                  { return c.attacker < npcs.size() && resting(npcs.id_at(c.attacker)); });
+}
+
+void AttackCooldowns::start(const NpcStore &npcs, std::span<const FightOutcome> outcomes)
+{
+    for (const auto &outcome : outcomes)
+    {
+        if (!outcome.win || outcome.attacker >= npcs.size())
+            continue;
+        const NpcId id = npcs.id_at(outcome.attacker);
+        if (id.index >= rest.size())
+            rest.resize(id.index + 1);
+        Rest &r = rest[id.index];
+        if (r.on && r.generation == id.generation)
+            continue;
+        r = {id.generation, true};
+        wheel.schedule(ticks, (static_cast<std::uint64_t>(id.generation) << 32) | id.index);
+    }
+}
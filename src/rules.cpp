@@ -0,0 +1,27 @@
+#include "../include/rules.h"
+
+MoveRule rules_for(NpcType type)
+{
+    switch (type)
+    {
+    case OrkType:
+        return {20, 10};
+    case SquirrelType:
+        return {5, 5};
+    case DruidType:
+        return {10, 10};
+    default:
+        return {1, 1};
+    }
+}
+
+bool can_attack(NpcType attacker, NpcType defender)
+{
+    return (attacker == OrkType && defender == DruidType) ||
+           (attacker == DruidType && defender == SquirrelType);
+}
+
+bool has_prey(NpcType attacker)
+{
+    return attacker == OrkType || attacker == DruidType;
+}
@@ -0,0 +1,497 @@
+#include "../include/snapshot_server.h"
+
+#include "../include/format.h"
+
+#include <array>
+#include <cerrno>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace
+{
+    constexpr size_t MAX_PENDING = 16; // ответов в очереди клиента, дальше запросы ждут
+    constexpr size_t MAX_LINE = 256;
+    constexpr size_t MAX_BUFFERED = 64 * 1024;
+
+    // Заголовок ответа "OK <версия> <байт тела>" без '\n'; false, если он не такой.
+    bool parse_ok_header(std::string_view header, size_t &bytes)
+    {
+        if (header.substr(0, 3) != "OK ")
+            return false;
+        const char *end = header.data() + header.size();
+        std::uint64_t version = 0;
+        auto [next, ec] = std::from_chars(header.data() + 3, end, version);
+        if (ec != std::errc() || next == end || *next != ' ')
+            return false;
+        auto [last, size_ec] = std::from_chars(next + 1, end, bytes);
+        return size_ec == std::errc() && last == end;
+    }
+
+    bool make_address(const std::string &path, sockaddr_un &address)
+    {
+        std::memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        if (path.size() >= sizeof(address.sun_path))
+            return false;
+        std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+        return true;
+    }
+
+    void set_nonblocking(int fd)
+    {
+        ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    }
+}
+
+std::shared_ptr<const WorldSnapshot> WorldSnapshot::capture(const set_t &npcs, std::uint64_t version,
+                                                            std::vector<std::string> recent_kills,
+                                                            const std::shared_ptr<const WorldSnapshot> &previous)
+{
+    auto snapshot = std::make_shared<WorldSnapshot>();
+    snapshot->version = version;
+    snapshot->layout = npcs.layout_version();
+    snapshot->recent_kills = std::move(recent_kills);
+    snapshot->entries.reserve(npcs.size());
+    for (const auto &npc : npcs)
+    {
+        const auto [x, y] = npc->position();
+        snapshot->entries.push_back({x, y, npc->get_type(), npc->is_alive()});
+    }
+
+    if (previous && previous->layout == snapshot->layout && previous->names &&
+        previous->names->size() == npcs.size())
+    {
+        snapshot->names = previous->names;
+    }
+    else
+    {
+        auto names = std::make_shared<std::vector<std::string>>();
+        names->reserve(npcs.size());
+        for (const auto &npc : npcs)
+            names->push_back(npc->get_name());
+        snapshot->names = std::move(names);
+    }
+    return snapshot;
+}
+
+const WorldSnapshot::Text &WorldSnapshot::text() const
+{
+    std::call_once(rendered, [this]()
+                   {
+        auto &t = rendered_text;
+        t.version = std::to_string(version) + '\n';
+
+        std::array<size_t, NPC_TYPE_COUNT> alive{};
+        t.positions.reserve(entries.size() * 24);
+        for (size_t i = 0; i < entries.size(); ++i)
+        {
+            const Entry &e = entries[i];
+            if (!e.alive)
+                continue;
+            ++alive[e.type];
+            t.positions.append(type_name(e.type));
+            t.positions.push_back(' ');
+            t.positions.append((*names)[i]);
+            t.positions.push_back(' ');
+            t.positions.append(std::to_string(e.x));
+            t.positions.push_back(' ');
+            t.positions.append(std::to_string(e.y));
+            t.positions.push_back('\n');
+        }
+        for (auto type : {OrkType, SquirrelType, DruidType})
+        {
+            t.counts.append(type_name(type));
+            t.counts.push_back(' ');
+            t.counts.append(std::to_string(alive[type]));
+            t.counts.push_back('\n');
+        }
+        for (const auto &kill : recent_kills)
+        {
+            t.kills.append(kill);
+            t.kills.push_back('\n');
+        } });
+    return rendered_text;
+}
+
+const std::string &WorldSnapshot::version_text() const
+{
+    return text().version;
+}
+
+const std::string &WorldSnapshot::counts() const
+{
+    return text().counts;
+}
+
+const std::string &WorldSnapshot::positions() const
+{
+    return text().positions;
+}
+
+const std::string &WorldSnapshot::kills() const
+{
+    return text().kills;
+}
+
+void RecentKillsObserver::on_fight(const std::shared_ptr<NPC> attacker,
+                                   const std::shared_ptr<NPC> defender,
+                                   bool win)
+{
+    if (!win || !attacker || !defender)
+        return;
+    std::lock_guard<std::mutex> lck(mtx);
+    record(*attacker, *defender);
+}
+
+void RecentKillsObserver::on_fights(const NpcStore &npcs, std::span<const FightOutcome> outcomes)
+{
+    std::lock_guard<std::mutex> lck(mtx);
+    for (const auto &outcome : outcomes)
+    {
+        if (outcome.win)
+            record(*npcs[outcome.attacker], *npcs[outcome.defender]);
+    }
+}
+
+void RecentKillsObserver::record(const NPC &attacker, const NPC &defender)
+{
+    if (capacity == 0)
+        return;
+    std::string line;
+    append_npc(line, attacker);
+    line.append(" -> ");
+    append_npc(line, defender);
+    if (kills.size() == capacity)
+        kills.pop_front();
+    kills.push_back(std::move(line));
+}
+
+std::vector<std::string> RecentKillsObserver::recent() const
+{
+    std::lock_guard<std::mutex> lck(mtx);
+    return {kills.begin(), kills.end()};
+}
+
+struct SnapshotServer::Client
+{
+    struct Response
+    {
+        std::shared_ptr<const WorldSnapshot> snapshot; // держит тело живым до конца отправки
+        std::string header;
+        std::string_view body;
+        size_t sent{0};
+    };
+
+    int fd;
+    std::string input;
+    std::deque<Response> output;
+    bool eof{false}; // клиент закрыл запись: дослать ответы и закрыть
+};
+
+SnapshotServer::SnapshotServer(std::string path) : socket_path(std::move(path)) {}
+
+SnapshotServer::~SnapshotServer()
+{
+    stop();
+}
+
+bool SnapshotServer::start()
+{
+    sockaddr_un address;
+    if (!make_address(socket_path, address))
+    {
+        std::cerr << "Error: socket path too long: " << socket_path << std::endl;
+        return false;
+    }
+
+    listen_fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0 || ::pipe2(wake_fds, O_CLOEXEC | O_NONBLOCK) != 0)
+    {
+        std::cerr << "Error: " << std::strerror(errno) << std::endl;
+        stop();
+        return false;
+    }
+    struct stat existing;
+    if (::lstat(socket_path.c_str(), &existing) == 0)
+    {
+        if (!S_ISSOCK(existing.st_mode))
+        {
+            std::cerr << "Error: " << socket_path << ": exists and is not a socket" << std::endl;
+            stop();
+            return false;
+        }
+        ::unlink(socket_path.c_str());
+    }
+    if (::bind(listen_fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0)
+    {
+        std::cerr << "Error: " << socket_path << ": " << std::strerror(errno) << std::endl;
+        stop();
+        return false;
+    }
+    bound = true;
+    if (::listen(listen_fd, 64) != 0)
+    {
+        std::cerr << "Error: " << socket_path << ": " << std::strerror(errno) << std::endl;
+        stop();
+        return false;
+    }
+    set_nonblocking(listen_fd);
+
+    worker = std::thread([this]()
+                         { loop(); });
+    return true;
+}
+
+void SnapshotServer::stop()
+{
+    if (worker.joinable())
+    {
+        const char byte = 0;
+        [[maybe_unused]] const auto written = ::write(wake_fds[1], &byte, 1);
+        worker.join();
+    }
+    if (listen_fd >= 0)
+    {
+        ::close(listen_fd);
+        if (bound)
+            ::unlink(socket_path.c_str());
+        bound = false;
+        listen_fd = -1;
+    }
+    for (int &fd : wake_fds)
+    {
+        if (fd >= 0)
+            ::close(fd);
+        fd = -1;
+    }
+}
+
+void SnapshotServer::publish(std::shared_ptr<const WorldSnapshot> next)
+{
+    snapshot.store(std::move(next), std::memory_order_release);
+}
+
+std::shared_ptr<const WorldSnapshot> SnapshotServer::current() const
+{
+    return snapshot.load(std::memory_order_acquire);
+}
+
+bool SnapshotServer::handle_input(Client &client)
+{
+    char buffer[512];
+    while (client.input.size() < MAX_BUFFERED)
+    {
+        const auto n = ::read(client.fd, buffer, sizeof(buffer));
+        if (n == 0)
+        {
+            client.eof = true;
+            return true;
+        }
+        if (n < 0)
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+        client.input.append(buffer, static_cast<size_t>(n));
+    }
+    return true;
+}
+
+bool SnapshotServer::answer_requests(Client &client)
+{
+    size_t consumed = 0;
+    size_t newline;
+    while (client.output.size() < MAX_PENDING && (newline = client.input.find('\n', consumed)) != std::string::npos)
+    {
+        std::string_view command(client.input.data() + consumed, newline - consumed);
+        consumed = newline + 1;
+        if (!command.empty() && command.back() == '\r')
+            command.remove_suffix(1);
+
+        Client::Response response;
+        response.snapshot = current();
+        const WorldSnapshot *s = response.snapshot.get();
+        if (!s)
+            response.header = "ERR no snapshot yet\n";
+        else if (command == "VERSION")
+            response.body = s->version_text();
+        else if (command == "COUNTS")
+            response.body = s->counts();
+        else if (command == "POSITIONS")
+            response.body = s->positions();
+        else if (command == "KILLS")
+            response.body = s->kills();
+        else
+            response.header = "ERR unknown command\n";
+        if (response.header.empty())
+            response.header = "OK " + std::to_string(s->version) + ' ' + std::to_string(response.body.size()) + '\n';
+        client.output.push_back(std::move(response));
+        responses.fetch_add(1, std::memory_order_relaxed);
+    }
+    client.input.erase(0, consumed);
+    // Строка без перевода строки длиннее любой команды — клиент не говорит по протоколу.
+    return client.input.find('\n') != std::string::npos || client.input.size() <= MAX_LINE;
+}
+
+bool SnapshotServer::flush_output(Client &client)
+{
+    while (!client.output.empty())
+    {
+        auto &r = client.output.front();
+        iovec parts[2];
+        int count = 0;
+        if (r.sent < r.header.size())
+            parts[count++] = {r.header.data() + r.sent, r.header.size() - r.sent};
+        const size_t body_sent = r.sent > r.header.size() ? r.sent - r.header.size() : 0;
+        if (body_sent < r.body.size())
+            parts[count++] = {const_cast<char *>(r.body.data()) + body_sent, r.body.size() - body_sent};
+        if (count == 0)
+        {
+            client.output.pop_front();
+            continue;
+        }
+
+        msghdr message{};
+        message.msg_iov = parts;
+        message.msg_iovlen = static_cast<size_t>(count);
+        const auto n = ::sendmsg(client.fd, &message, MSG_NOSIGNAL);
+        if (n < 0)
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+        r.sent += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+void SnapshotServer::loop()
+{
+    std::deque<Client> clients;
+    std::vector<pollfd> fds;
+    while (true)
+    {
+        fds.clear();
+        fds.push_back({wake_fds[0], POLLIN, 0});
+        fds.push_back({listen_fd, POLLIN, 0});
+        for (const auto &c : clients)
+        {
+            short events = 0;
+            if (!c.eof && c.input.size() < MAX_BUFFERED)
+                events |= POLLIN;
+            if (!c.output.empty())
+                events |= POLLOUT;
+            fds.push_back({c.fd, events, 0});
+        }
+
+        if (::poll(fds.data(), fds.size(), -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        if (fds[0].revents)
+            break;
+
+        // Новые клиенты добавляются в конец, поэтому индексы fds для старых не сдвигаются.
+        const size_t known = clients.size();
+        if (fds[1].revents & POLLIN)
+        {
+            int fd;
+            while ((fd = ::accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+                clients.push_back({fd, {}, {}, false});
+        }
+
+        for (size_t i = 0; i < known; ++i)
+        {
+            auto &c = clients[i];
+            const short revents = fds[i + 2].revents;
+            bool keep = !(revents & (POLLERR | POLLNVAL));
+            if (keep && !c.eof && (revents & (POLLIN | POLLHUP)))
+                keep = handle_input(c);
+            // Ответы отправляются, освободившиеся места в очереди занимают ждущие запросы.
+            if (keep)
+                keep = answer_requests(c) && flush_output(c) && answer_requests(c);
+            // После конца ввода соединение живёт, пока не уйдут все ответы.
+            if (keep && c.eof && c.output.empty() && c.input.find('\n') == std::string::npos)
+                keep = false;
+            if (!keep)
+            {
+                ::close(c.fd);
+                c.fd = -1;
+            }
+        }
+        std::erase_if(clients, [](const Client &c)
+                      { return c.fd < 0; });
+    }
+
+    for (auto &c : clients)
+        ::close(c.fd);
+}
+
+std::string query_snapshot(const std::string &socket_path, std::string_view command, std::string *error)
+{
+    auto fail = [&](const std::string &message)
+    {
+        if (error)
+            *error = message;
+        return std::string();
+    };
+
+    sockaddr_un address;
+    if (!make_address(socket_path, address))
+        return fail("socket path too long");
+    const int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return fail(std::strerror(errno));
+    if (::connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0)
+    {
+        const std::string message = std::strerror(errno);
+        ::close(fd);
+        return fail(message);
+    }
+
+    std::string request(command);
+    request.push_back('\n');
+    if (::send(fd, request.data(), request.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(request.size()))
+    {
+        ::close(fd);
+        return fail("short write");
+    }
+
+    std::string reply;
+    char buffer[4096];
+    size_t expected = std::string::npos;
+    size_t header_end = std::string::npos;
+    while (expected == std::string::npos || reply.size() < expected)
+    {
+        const auto n = ::read(fd, buffer, sizeof(buffer));
+        if (n <= 0)
+            break;
+        reply.append(buffer, static_cast<size_t>(n));
+        if (header_end == std::string::npos && (header_end = reply.find('\n')) != std::string::npos)
+        {
+            if (reply.rfind("OK ", 0) != 0)
+            {
+                ::close(fd);
+                return fail(reply.substr(0, header_end));
+            }
+            size_t bytes = 0;
+            if (!parse_ok_header(std::string_view(reply).substr(0, header_end), bytes))
+            {
+                ::close(fd);
+                return fail("malformed header: " + reply.substr(0, header_end));
+            }
+            expected = header_end + 1 + bytes;
+        }
+    }
+    ::close(fd);
+    if (expected == std::string::npos || reply.size() < expected)
+        return fail("connection closed");
+    if (error)
+        error->clear();
+    return reply.substr(header_end + 1, expected - header_end - 1);
+}
@@ -0,0 +1,220 @@
+#include "../include/spatial.h"
+
+#include "../include/rules.h"
+
+#include <algorithm>
+#include <future>
+#include <limits>
+
+namespace
+{
+    constexpr size_t PARALLEL_BUILD_MIN = 4096;
+
+    bool hit_less(const SpatialHit &a, const SpatialHit &b)
+    {
+        return a.distance2 < b.distance2 || (a.distance2 == b.distance2 && a.index < b.index);
+    }
+}
+
+TypeMask prey_mask(NpcType attacker)
+{
+    TypeMask mask = 0;
+    for (size_t t = 0; t < NPC_TYPE_COUNT; ++t)
+        if (can_attack(attacker, static_cast<NpcType>(t)))
+            mask |= type_mask(static_cast<NpcType>(t));
+    return mask;
+}
+
+TypeMask predator_mask(NpcType defender)
+{
+    TypeMask mask = 0;
+    for (size_t t = 0; t < NPC_TYPE_COUNT; ++t)
+        if (can_attack(static_cast<NpcType>(t), defender))
+            mask |= type_mask(static_cast<NpcType>(t));
+    return mask;
+}
+
+struct SpatialIndex::Query
+{
+    long long x;
+    long long y;
+    size_t k;
+    long long radius2;
+    TypeMask mask;
+    size_t exclude;
+    std::vector<SpatialHit> &hits; // для k_nearest — max-heap по hit_less
+
+    long long worst() const
+    {
+        if (k == 0)
+            return radius2;
+        return hits.size() < k ? radius2 : hits.front().distance2;
+    }
+};
+
+void SpatialIndex::rebuild(const set_t &npcs, ThreadPool *pool)
+{
+    nodes.clear();
+    nodes.reserve(npcs.size());
+    for (size_t i = 0; i < npcs.size(); ++i)
+    {
+        const auto &npc = npcs[i];
+        if (!npc->is_alive())
+            continue;
+        const auto [x, y] = npc->position();
+        const TypeMask type = type_mask(npc->get_type());
+        nodes.push_back({x, y, static_cast<std::uint32_t>(i), type, type});
+    }
+
+    if (!pool || pool->size() == 0 || nodes.size() < PARALLEL_BUILD_MIN)
+    {
+        build(0, nodes.size(), 0);
+        return;
+    }
+
+    // Верхние уровни делятся в вызывающем потоке, поддеревья строятся в пуле.
+    size_t levels = 0;
+    while ((size_t{1} << levels) < pool->size() * 2)
+        ++levels;
+    std::vector<size_t> jobs;
+    split_top(0, nodes.size(), 0, levels, jobs);
+
+    std::vector<std::future<void>> pending;
+    pending.reserve(jobs.size() / 3);
+    for (size_t j = 0; j < jobs.size(); j += 3)
+    {
+        const size_t begin = jobs[j], end = jobs[j + 1], depth = jobs[j + 2];
+        pending.push_back(pool->submit([this, begin, end, depth]()
+                                       { build(begin, end, depth); }));
+    }
+    for (auto &f : pending)
+        f.get();
+    finish_top(0, nodes.size(), levels);
+}
+
+TypeMask SpatialIndex::build(size_t begin, size_t end, size_t depth)
+{
+    if (begin >= end)
+        return 0;
+    const size_t mid = begin + (end - begin) / 2;
+    const bool by_x = depth % 2 == 0;
+    std::nth_element(nodes.begin() + begin, nodes.begin() + mid, nodes.begin() + end,
+                     [by_x](const Node &a, const Node &b)
+                     { return by_x ? a.x < b.x : a.y < b.y; });
+    Node &node = nodes[mid];
+    node.subtree = node.type | build(begin, mid, depth + 1) | build(mid + 1, end, depth + 1);
+    return node.subtree;
+}
+
+void SpatialIndex::split_top(size_t begin, size_t end, size_t depth, size_t levels, std::vector<size_t> &jobs)
+{
+    if (levels == 0 || end - begin < PARALLEL_BUILD_MIN)
+    {
+        jobs.insert(jobs.end(), {begin, end, depth});
+        return;
+    }
+    const size_t mid = begin + (end - begin) / 2;
+    const bool by_x = depth % 2 == 0;
+    std::nth_element(nodes.begin() + begin, nodes.begin() + mid, nodes.begin() + end,
+                     [by_x](const Node &a, const Node &b)
+                     { return by_x ? a.x < b.x : a.y < b.y; });
+    split_top(begin, mid, depth + 1, levels - 1, jobs);
+    split_top(mid + 1, end, depth + 1, levels - 1, jobs);
+}
+
+TypeMask SpatialIndex::finish_top(size_t begin, size_t end, size_t levels)
+{
+    if (begin >= end)
+        return 0;
+    const size_t mid = begin + (end - begin) / 2;
+    if (levels == 0 || end - begin < PARALLEL_BUILD_MIN)
+        return nodes[mid].subtree;
+    Node &node = nodes[mid];
+    node.subtree = node.type | finish_top(begin, mid, levels - 1) | finish_top(mid + 1, end, levels - 1);
+    return node.subtree;
+}
+
+std::optional<SpatialHit> SpatialIndex::nearest(int x, int y, TypeMask mask, size_t exclude) const
+{
+    std::vector<SpatialHit> hits;
+    k_nearest(x, y, 1, mask, hits, exclude);
+    if (hits.empty())
+        return std::nullopt;
+    return hits.front();
+}
+
+void SpatialIndex::k_nearest(int x, int y, size_t k, TypeMask mask, std::vector<SpatialHit> &out,
+                             size_t exclude) const
+{
+    out.clear();
+    if (k == 0)
+        return;
+    Query query{x, y, k, std::numeric_limits<long long>::max(), mask, exclude, out};
+    search_k(0, nodes.size(), 0, query);
+    std::sort_heap(out.begin(), out.end(), hit_less);
+}
+
+void SpatialIndex::within_radius(int x, int y, size_t radius, TypeMask mask, std::vector<SpatialHit> &out,
+                                 size_t exclude) const
+{
+    out.clear();
+    const auto r = static_cast<long long>(radius);
+    Query query{x, y, 0, r * r, mask, exclude, out};
+    search_radius(0, nodes.size(), 0, query);
+    std::sort(out.begin(), out.end(), hit_less);
+}
+
+void SpatialIndex::search_k(size_t begin, size_t end, size_t depth, Query &query) const
+{
+    if (begin >= end)
+        return;
+    const size_t mid = begin + (end - begin) / 2;
+    const Node &node = nodes[mid];
+    if (!(node.subtree & query.mask))
+        return;
+
+    if ((node.type & query.mask) && node.index != query.exclude)
+    {
+        const long long dx = node.x - query.x;
+        const long long dy = node.y - query.y;
+        const SpatialHit hit{node.index, dx * dx + dy * dy};
+        if (query.hits.size() < query.k)
+        {
+            query.hits.push_back(hit);
+            std::push_heap(query.hits.begin(), query.hits.end(), hit_less);
+        }
+        else if (hit_less(hit, query.hits.front()))
+        {
+            std::pop_heap(query.hits.begin(), query.hits.end(), hit_less);
+            query.hits.back() = hit;
+            std::push_heap(query.hits.begin(), query.hits.end(), hit_less);
+        }
+    }
+
+    const long long diff = depth % 2 == 0 ? query.x - node.x : query.y - node.y;
+    const bool left_first = diff < 0;
+    search_k(left_first ? begin : mid + 1, left_first ? mid : end, depth + 1, query);
+    if (diff * diff <= query.worst())
+        search_k(left_first ? mid + 1 : begin, left_first ? end : mid, depth + 1, query);
+}
+
+void SpatialIndex::search_radius(size_t begin, size_t end, size_t depth, Query &query) const
+{
+    if (begin >= end)
+        return;
+    const size_t mid = begin + (end - begin) / 2;
+    const Node &node = nodes[mid];
+    if (!(node.subtree & query.mask))
+        return;
+
+    const long long dx = node.x - query.x;
+    const long long dy = node.y - query.y;
+    if ((node.type & query.mask) && node.index != query.exclude && dx * dx + dy * dy <= query.radius2)
+        query.hits.push_back({node.index, dx * dx + dy * dy});
+
+    const long long diff = depth % 2 == 0 ? query.x - node.x : query.y - node.y;
+    if (diff <= 0 || diff * diff <= query.radius2)
+        search_radius(begin, mid, depth + 1, query);
+    if (diff >= 0 || diff * diff <= query.radius2)
+        search_radius(mid + 1, end, depth + 1, query);
+}
@@ -36,7 +36,7 @@ bool Squirrel::fight(const std::shared_ptr<Druid> &other)
 
 void Squirrel::print() const
 {
-    std::cout << "Squirrel " << name << " (" << get_x() << ", " << get_y() << ")" << std::endl;
+    print_to(std::cout);
 }
 
 void Squirrel::save(std::ostream &os) const
@@ -0,0 +1,47 @@
+#include "../include/thread_pool.h"
+
+ThreadPool::ThreadPool(size_t threads)
+{
+    workers.reserve(threads);
+    for (size_t i = 0; i < threads; ++i)
+        workers.emplace_back([this]()
+                             { worker_loop(); });
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lck(mtx);
+        stopped = true;
+    }
+    cv.notify_all();
+    for (auto &worker : workers)
+        worker.join();
+}
+
+void ThreadPool::enqueue(std::function<void()> task)
+{
+    {
+        std::lock_guard<std::mutex> lck(mtx);
+        tasks.push(std::move(task));
+    }
+    cv.notify_one();
+}
+
+void ThreadPool::worker_loop()
+{
+    for (;;)
+    {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lck(mtx);
+            cv.wait(lck, [&]()
+                    { return stopped || !tasks.empty(); });
+            if (tasks.empty())
+                return;
+            task = std::move(tasks.front());
+            tasks.pop();
+        }
+        task();
+    }
+}
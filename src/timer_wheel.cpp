@@ -0,0 +1,147 @@
+#include "../include/timer_wheel.h"
+
+#include <algorithm>
+
+void TimerWheel::reserve(size_t timers)
+{
+    nodes.reserve(timers);
+    free_nodes.reserve(timers);
+}
+
+TimerId TimerWheel::schedule(std::uint64_t delay, std::uint64_t payload)
+{
+    std::uint32_t index;
+    if (!free_nodes.empty())
+    {
+        index = free_nodes.back();
+        free_nodes.pop_back();
+    }
+    else
+    {
+        index = static_cast<std::uint32_t>(nodes.size());
+        nodes.push_back({0, 0, NIL, NIL, NIL, 0, false});
+    }
+
+    Node &node = nodes[index];
+    // Нулевая задержка срабатывает на следующем тике.
+    node.expires = current + std::max<std::uint64_t>(delay, 1);
+    node.payload = payload;
+    node.live = true;
+    insert(index);
+    ++active;
+    return {index, node.generation};
+}
+
+bool TimerWheel::pending(TimerId id) const noexcept
+{
+    return id.index < nodes.size() && nodes[id.index].live && nodes[id.index].generation == id.generation;
+}
+
+bool TimerWheel::cancel(TimerId id)
+{
+    if (!pending(id))
+        return false;
+    unlink(id.index);
+    release(id.index);
+    return true;
+}
+
+void TimerWheel::release(std::uint32_t index)
+{
+    Node &node = nodes[index];
+    node.live = false;
+    ++node.generation;
+    free_nodes.push_back(index);
+    --active;
+}
+
+void TimerWheel::insert(std::uint32_t index)
+{
+    Node &node = nodes[index];
+    const std::uint64_t delta = node.expires - current;
+    unsigned level = 0;
+    while (level + 1 < LEVELS && delta >= (std::uint64_t{1} << (LEVEL_BITS * (level + 1))))
+        ++level;
+    // Слишком дальние таймеры ставятся в самый дальний слот верхнего уровня.
+    const std::uint64_t max_delta = (std::uint64_t{1} << (LEVEL_BITS * LEVELS)) - 1;
+    const std::uint64_t when = current + std::min(delta, max_delta);
+    const auto slot = static_cast<std::uint32_t>(level * SLOTS + ((when >> (LEVEL_BITS * level)) & (SLOTS - 1)));
+
+    node.slot = slot;
+    node.prev = NIL;
+    node.next = heads[slot];
+    if (node.next != NIL)
+        nodes[node.next].prev = index;
+    heads[slot] = index;
+}
+
+void TimerWheel::unlink(std::uint32_t index)
+{
+    Node &node = nodes[index];
+    if (node.slot == NIL)
+        return;
+    if (node.prev != NIL)
+        nodes[node.prev].next = node.next;
+    else
+        heads[node.slot] = node.next;
+    if (node.next != NIL)
+        nodes[node.next].prev = node.prev;
+    node.slot = NIL;
+    node.prev = node.next = NIL;
+}
+
+void TimerWheel::cascade(unsigned level)
+{
+    const auto slot = static_cast<std::uint32_t>(level * SLOTS + ((current >> (LEVEL_BITS * level)) & (SLOTS - 1)));
+    moving.clear();
+    for (std::uint32_t i = heads[slot]; i != NIL; i = nodes[i].next)
+        moving.push_back(i);
+    heads[slot] = NIL;
+    for (const auto i : moving)
+    {
+        nodes[i].slot = NIL;
+        insert(i);
+    }
+}
+
+void TimerWheel::collect_due()
+{
+    // На границе оборота уровня его текущий слот следующего уровня спускается вниз;
+    // старшие уровни раньше младших, чтобы спущенное ими тоже успело разойтись.
+    unsigned top = 0;
+    while (top + 1 < LEVELS && (current & ((std::uint64_t{1} << (LEVEL_BITS * (top + 1))) - 1)) == 0)
+        ++top;
+    for (unsigned level = top; level >= 1; --level)
+        cascade(level);
+
+    firing.clear();
+    const auto slot = static_cast<std::uint32_t>(current & (SLOTS - 1));
+    std::uint32_t i = heads[slot];
+    heads[slot] = NIL;
+    while (i != NIL)
+    {
+        Node &node = nodes[i];
+        const std::uint32_t next = node.next;
+        node.slot = NIL;
+        node.prev = node.next = NIL;
+        if (node.expires <= current)
+            firing.push_back({{i, node.generation}, node.payload});
+        else
+            insert(i); // ждал на верхнем уровне дольше 2^32 тиков
+        i = next;
+    }
+}
+
+std::uint64_t TimerWheel::ticks_until_next(std::uint64_t limit) const noexcept
+{
+    const std::uint64_t horizon = std::min<std::uint64_t>(limit, SLOTS);
+    for (std::uint64_t d = 1; d <= horizon; ++d)
+    {
+        if (heads[(current + d) & (SLOTS - 1)] != NIL)
+            return d;
+        // Следующий каскад может принести таймеры с верхних уровней.
+        if (((current + d) & (SLOTS - 1)) == 0)
+            return d;
+    }
+    return limit;
+}
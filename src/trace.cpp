@@ -0,0 +1,221 @@
+#include "../include/trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <vector>
+
+namespace
+{
+    // Ячейка кольца: поля атомарны, чтобы экспорт мог читать кольцо, пока владелец пишет.
+    struct Slot
+    {
+        std::atomic<const char *> name{nullptr};
+        std::atomic<std::int64_t> start_ns{0};
+        std::atomic<std::int64_t> duration_ns{0};
+    };
+
+    // Кольцо одного потока без блокировок: пишет только владелец. Перед записью ячейки он
+    // увеличивает claimed, после — written; читатель отбрасывает ячейки, которые могли
+    // быть перезаписаны за время копирования (seqlock по номеру события).
+    struct ThreadBuffer
+    {
+        std::atomic<Slot *> ring{nullptr}; // выделяется при первом событии
+        std::unique_ptr<Slot[]> storage;
+        size_t capacity{0};
+        std::atomic<size_t> claimed{0};
+        std::atomic<size_t> written{0};
+        std::atomic<size_t> floor{0}; // события до floor сброшены trace_clear
+        std::uint32_t tid{0};
+        std::string name; // под Registry::mtx
+    };
+
+    struct Registry
+    {
+        std::mutex mtx;
+        std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+        std::uint32_t next_tid{1};
+        std::atomic<size_t> capacity{1 << 16};
+        std::chrono::steady_clock::time_point epoch{std::chrono::steady_clock::now()};
+    };
+
+    Registry &registry()
+    {
+        static Registry r;
+        return r;
+    }
+
+    // Регистрация потока дешёвая; кольцо здесь не выделяется.
+    ThreadBuffer &local_buffer()
+    {
+        thread_local std::shared_ptr<ThreadBuffer> buffer = []()
+        {
+            auto b = std::make_shared<ThreadBuffer>();
+            auto &r = registry();
+            std::lock_guard<std::mutex> lck(r.mtx);
+            b->tid = r.next_tid++;
+            b->name = "thread " + std::to_string(b->tid);
+            r.buffers.push_back(b);
+            return b;
+        }();
+        return *buffer;
+    }
+
+    // Копия живых событий буфера от самого старого; вызывается под Registry::mtx.
+    std::vector<TraceEvent> snapshot(const ThreadBuffer &b)
+    {
+        std::vector<TraceEvent> events;
+        const Slot *ring = b.ring.load(std::memory_order_acquire);
+        if (!ring)
+            return events;
+        const size_t cap = b.capacity;
+        const size_t end = b.written.load(std::memory_order_acquire);
+        const size_t begin = std::max(b.floor.load(std::memory_order_relaxed), end > cap ? end - cap : 0);
+        events.reserve(end - std::min(begin, end));
+        for (size_t k = begin; k < end; ++k)
+        {
+            const Slot &slot = ring[k % cap];
+            events.push_back({slot.name.load(std::memory_order_relaxed),
+                              slot.start_ns.load(std::memory_order_relaxed),
+                              slot.duration_ns.load(std::memory_order_relaxed)});
+        }
+        // Событие k затирается событием k + cap; всё, что владелец успел занять, отбрасывается.
+        std::atomic_thread_fence(std::memory_order_acquire);
+        const size_t claimed = b.claimed.load(std::memory_order_relaxed);
+        const size_t valid_from = claimed > cap ? claimed - cap : 0;
+        if (valid_from > begin)
+            events.erase(events.begin(), events.begin() + static_cast<std::ptrdiff_t>(std::min(valid_from - begin, events.size())));
+        return events;
+    }
+
+    void append_escaped(std::string &out, const char *text)
+    {
+        for (const char *p = text; *p; ++p)
+        {
+            if (*p == '"' || *p == '\\')
+                out.push_back('\\');
+            out.push_back(*p);
+        }
+    }
+
+    void append_us(std::string &out, std::int64_t ns)
+    {
+        out += std::to_string(ns / 1000);
+        out.push_back('.');
+        const auto frac = std::to_string(ns % 1000 + 1000);
+        out.append(frac, 1, 3);
+    }
+}
+
+namespace trace_detail
+{
+    std::atomic<bool> enabled{false};
+
+    std::int64_t now_ns() noexcept
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() -
+                                                                    registry().epoch)
+            .count();
+    }
+
+    void record(const char *name, std::int64_t start_ns, std::int64_t end_ns) noexcept
+    {
+        auto &b = local_buffer();
+        Slot *ring = b.ring.load(std::memory_order_relaxed);
+        if (!ring)
+        {
+            const size_t cap = registry().capacity.load(std::memory_order_relaxed);
+            b.storage.reset(new (std::nothrow) Slot[cap]);
+            if (!b.storage)
+                return;
+            b.capacity = cap;
+            ring = b.storage.get();
+            b.ring.store(ring, std::memory_order_release);
+        }
+        const size_t n = b.written.load(std::memory_order_relaxed);
+        b.claimed.store(n + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        Slot &slot = ring[n % b.capacity];
+        slot.name.store(name, std::memory_order_relaxed);
+        slot.start_ns.store(start_ns, std::memory_order_relaxed);
+        slot.duration_ns.store(end_ns - start_ns, std::memory_order_relaxed);
+        b.written.store(n + 1, std::memory_order_release);
+    }
+}
+
+void trace_enable(size_t capacity)
+{
+    registry().capacity.store(std::max<size_t>(1, capacity), std::memory_order_relaxed);
+    trace_detail::enabled.store(true, std::memory_order_relaxed);
+}
+
+void trace_disable()
+{
+    trace_detail::enabled.store(false, std::memory_order_relaxed);
+}
+
+void trace_clear()
+{
+    auto &r = registry();
+    std::lock_guard<std::mutex> lck(r.mtx);
+    for (auto &b : r.buffers)
+        b->floor.store(b->written.load(std::memory_order_acquire), std::memory_order_relaxed);
+}
+
+void trace_thread_name(const char *name)
+{
+    auto &b = local_buffer();
+    std::lock_guard<std::mutex> lck(registry().mtx);
+    b.name = name;
+}
+
+size_t trace_event_count()
+{
+    auto &r = registry();
+    std::lock_guard<std::mutex> lck(r.mtx);
+    size_t total = 0;
+    for (auto &b : r.buffers)
+        total += snapshot(*b).size();
+    return total;
+}
+
+void trace_write_chrome(std::ostream &os)
+{
+    std::string out = "{\"traceEvents\":[";
+    bool first = true;
+    auto separator = [&]()
+    {
+        if (!first)
+            out.push_back(',');
+        first = false;
+        out.push_back('\n');
+    };
+
+    auto &r = registry();
+    std::lock_guard<std::mutex> lck(r.mtx);
+    for (auto &b : r.buffers)
+    {
+        const std::string tid = std::to_string(b->tid);
+        separator();
+        out += "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" + tid + ",\"args\":{\"name\":\"";
+        append_escaped(out, b->name.c_str());
+        out += "\"}}";
+
+        for (const TraceEvent &e : snapshot(*b))
+        {
+            separator();
+            out += "{\"name\":\"";
+            append_escaped(out, e.name);
+            out += "\",\"ph\":\"X\",\"pid\":1,\"tid\":" + tid + ",\"ts\":";
+            append_us(out, e.start_ns);
+            out += ",\"dur\":";
+            append_us(out, e.duration_ns);
+            out.push_back('}');
+        }
+    }
+    out += "\n],\"displayTimeUnit\":\"ms\"}\n";
+    os << out;
+}
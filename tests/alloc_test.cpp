@@ -0,0 +1,124 @@
+#include "../include/battle.h"
+#include "../include/factory.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+// Отдельный исполняемый файл: глобальная замена operator new/delete считает аллокации
+// текущего потока и не должна влиять на остальные тесты.
+
+namespace
+{
+    thread_local size_t thread_allocations = 0;
+
+    void *counted_allocate(std::size_t size)
+    {
+        ++thread_allocations;
+        if (void *p = std::malloc(size ? size : 1))
+            return p;
+        throw std::bad_alloc();
+    }
+
+    class BatchObserver : public IFightObserver
+    {
+    public:
+        void on_fight(const std::shared_ptr<NPC>, const std::shared_ptr<NPC>, bool) override {}
+        void on_fights(const NpcStore &, std::span<const FightOutcome> outcomes) override { total += outcomes.size(); }
+
+        size_t total{0};
+    };
+
+    set_t make_random_world(size_t count, int side, unsigned int seed,
+                            const std::vector<std::shared_ptr<IFightObserver>> &observers)
+    {
+        std::mt19937 rng(seed);
+        std::uniform_int_distribution<int> coord(0, side);
+        std::uniform_int_distribution<int> type(1, 3);
+        set_t npcs;
+        npcs.reserve(count);
+        for (size_t i = 0; i < count; ++i)
+            npcs.insert(factory(static_cast<NpcType>(type(rng)), "w" + std::to_string(i), coord(rng), coord(rng), observers));
+        return npcs;
+    }
+
+    std::vector<std::string> sorted_names(const set_t &npcs)
+    {
+        std::vector<std::string> names;
+        for (const auto &npc : npcs)
+            names.push_back(npc->get_name());
+        std::sort(names.begin(), names.end());
+        return names;
+    }
+}
+
+// Все формы без выравнивания идут через malloc/free, поэтому пары new/delete согласованы.
+void *operator new(std::size_t size)
+{
+    return counted_allocate(size);
+}
+
+void *operator new[](std::size_t size)
+{
+    return counted_allocate(size);
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void *p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+TEST(FightInto, NoAllocationsAfterWarmUp)
+{
+    auto observer = std::make_shared<BatchObserver>();
+    auto world = make_random_world(5000, 300, 31, {observer});
+    auto reference = make_random_world(5000, 300, 31, {});
+
+    FightBuffers buffers;
+    for (int round = 0; round < 4; ++round)
+    {
+        seed_random(70 + round);
+        const auto expected = fight(reference, 10);
+
+        seed_random(70 + round);
+        const size_t before = thread_allocations;
+        const size_t deaths = fight_into(world, 10, buffers);
+        const size_t allocations = thread_allocations - before;
+        if (round == 0)
+            EXPECT_GT(allocations, 0u); // счётчик действительно видит аллокации прогрева
+        else
+            EXPECT_EQ(allocations, 0u) << "round " << round;
+
+        ASSERT_EQ(deaths, expected.size());
+        std::vector<std::string> names;
+        for (const auto index : buffers.deaths())
+        {
+            EXPECT_FALSE(world[index]->is_alive());
+            names.push_back(world[index]->get_name());
+        }
+        std::sort(names.begin(), names.end());
+        EXPECT_EQ(names, sorted_names(expected));
+    }
+    EXPECT_GT(observer->total, 0u);
+}
@@ -0,0 +1,358 @@
+#include "../include/battle.h"
+#include "../include/movement.h"
+#include "../include/packed.h"
+#include "../include/partition.h"
+#include "../include/resolver.h"
+#include "../include/rules.h"
+#include "../include/spatial.h"
+#include "../include/thread_pool.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Масштабные прогоны: миры на 1k/100k/1M (и квадратный 30k) NPC из seed, один сценарий на разном
+// числе потоков. Исходы должны совпадать бит в бит.
+//
+// Пропускная способность fight-цикла хранится в tests/scale_baselines.txt строками
+// "<сборка> <сценарий> <доля>", где доля — NPC-тики/с цикла с fight(), делённые на NPC-тики/с
+// того же цикла только со сдвигами, замеренного в том же процессе. Эталон убирает скорость
+// машины, замедление fight() снижает долю. Падение ниже базы * NPC_SCALE_TOLERANCE
+// (по умолчанию 0.6) — провал; NPC_SCALE_UPDATE=1 записывает замеренные доли текущей сборки.
+// Пул из 4 потоков сверяется с последовательным fight() только на больших сценариях:
+// на 1k накладные расходы пула больше самой работы.
+//
+// Набор долгий (минуты в отладочной сборке), поэтому в ctest он только в конфигурации
+// Scale: ctest -C Scale -L scale.
+
+#ifndef NPC_SCALE_BASELINES
+#define NPC_SCALE_BASELINES "scale_baselines.txt"
+#endif
+#ifndef NPC_SCALE_BUILD
+#define NPC_SCALE_BUILD ""
+#endif
+
+namespace
+{
+    struct Scenario
+    {
+        const char *name;
+        size_t npcs;
+        int width;
+        int height;
+        size_t ticks;
+    };
+
+    // Плотность ~0.01-0.1 NPC на клетку: бои идут, но мир не вымирает за первые тики.
+    // fight() перебирает жертв в окне по x, поэтому большие карты вытянуты по x: на
+    // квадратной карте окно собирает ~N / width NPC и тик растёт как N^2 / width.
+    // Квадратный сценарий один и средний (30k): 100k на 3000x3000 уже в ~4 раза дороже
+    // вытянутого 100k на NPC-тик.
+    constexpr Scenario SCENARIOS[] = {
+        {"1k", 1000, 100, 100, 20},
+        {"100k", 100000, 30000, 300, 8},
+        {"1m", 1000000, 1000000, 100, 3},
+        {"30k_sq", 30000, 1700, 1700, 4},
+    };
+
+    constexpr size_t THREAD_COUNTS[] = {1, 2, 4, 8};
+    // С этого размера работа fight() перекрывает накладные расходы пула.
+    constexpr size_t POOL_GATE_NPCS = 100000;
+    constexpr std::uint64_t SEED = 0x5CA1E;
+
+    int kill_distance()
+    {
+        int distance = 0;
+        for (size_t type = 0; type < NPC_TYPE_COUNT; ++type)
+            if (has_prey(static_cast<NpcType>(type)))
+                distance = std::max(distance, rules_for(static_cast<NpcType>(type)).kill_distance);
+        return distance;
+    }
+
+    set_t make_world(const Scenario &scenario, int width)
+    {
+        static const std::vector<std::shared_ptr<IFightObserver>> observers;
+        set_t world;
+        world.reserve(scenario.npcs);
+        for (size_t i = 0; i < scenario.npcs; ++i)
+        {
+            const std::uint64_t bits = counter_bits(SEED, i);
+            const auto type = static_cast<NpcType>(1 + ((bits & 0xFFFF) * 3 >> 16));
+            const auto x = static_cast<int>(((bits >> 16) & 0xFFFF) * static_cast<std::uint64_t>(width) >> 16);
+            const auto y = static_cast<int>(((bits >> 32) & 0xFFFF) * static_cast<std::uint64_t>(scenario.height) >> 16);
+            world.insert(factory(type, "n" + std::to_string(i), x, y, observers));
+        }
+        return world;
+    }
+
+    void mix(std::uint64_t &hash, std::uint64_t value)
+    {
+        hash = counter_bits(hash, value);
+    }
+
+    std::uint64_t digest(const set_t &world)
+    {
+        std::uint64_t hash = world.size();
+        for (size_t i = 0; i < world.size(); ++i)
+        {
+            const auto &npc = world[i];
+            const auto [x, y] = npc->position();
+            mix(hash, std::hash<std::string>{}(npc->get_name()));
+            mix(hash, (static_cast<std::uint64_t>(static_cast<std::uint32_t>(x)) << 32) | static_cast<std::uint32_t>(y));
+            mix(hash, npc->is_alive());
+        }
+        return hash;
+    }
+
+    struct LoopResult
+    {
+        std::uint64_t digest{0};
+        std::vector<size_t> deaths; // по тикам
+        size_t npc_ticks{0};        // сумма живых на начало каждого тика
+        double seconds{0.0};
+    };
+
+    // Цикл task7 без таймеров: сдвиг каждого NPC из счётчикового генератора, fight(),
+    // удаление погибших. pool == nullptr — последовательный fight(); fights == false —
+    // только сдвиги (эталон скорости машины).
+    LoopResult run_loop(set_t &world, const Scenario &scenario, ThreadPool *pool, bool fights = true)
+    {
+        LoopResult result;
+        const auto distance = static_cast<size_t>(kill_distance());
+        const auto start = std::chrono::steady_clock::now();
+        for (size_t tick = 0; tick < scenario.ticks; ++tick)
+        {
+            result.npc_ticks += world.size();
+            const std::uint64_t tick_seed = counter_bits(SEED, scenario.npcs + tick);
+            for (size_t i = 0; i < world.size(); ++i)
+            {
+                const auto &npc = world[i];
+                const std::uint64_t bits = counter_bits(tick_seed, i);
+                const int step = rules_for(npc->get_type()).step;
+                const auto range = static_cast<std::uint64_t>(2 * step + 1);
+                const auto dx = static_cast<int>(((bits & 0xFFFFFFFFull) * range) >> 32) - step;
+                const auto dy = static_cast<int>(((bits >> 32) * range) >> 32) - step;
+                npc->move(dx, dy, scenario.width - 1, scenario.height - 1);
+            }
+
+            if (!fights)
+                continue;
+            seed_random(static_cast<unsigned int>(tick_seed));
+            const set_t dead = pool ? fight(world, distance, *pool) : fight(world, distance);
+            result.deaths.push_back(dead.size());
+            for (const auto &npc : dead)
+                world.erase(npc);
+        }
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        result.digest = digest(world);
+        return result;
+    }
+
+    LoopResult run_fresh(const Scenario &scenario, ThreadPool *pool, bool fights = true)
+    {
+        auto world = make_world(scenario, scenario.width);
+        return run_loop(world, scenario, pool, fights);
+    }
+
+    std::string build_name()
+    {
+        const std::string build = NPC_SCALE_BUILD;
+        return build.empty() ? "Default" : build;
+    }
+
+    double tolerance()
+    {
+        const char *value = std::getenv("NPC_SCALE_TOLERANCE");
+        return value ? std::strtod(value, nullptr) : 0.6;
+    }
+
+    bool updating()
+    {
+        const char *value = std::getenv("NPC_SCALE_UPDATE");
+        return value && std::string(value) == "1";
+    }
+
+    using Baselines = std::map<std::pair<std::string, std::string>, double>;
+
+    Baselines read_baselines()
+    {
+        Baselines baselines;
+        std::ifstream in(NPC_SCALE_BASELINES);
+        std::string line;
+        while (std::getline(in, line))
+        {
+            if (line.empty() || line[0] == '#')
+                continue;
+            std::istringstream fields(line);
+            std::string build, scenario;
+            double value = 0.0;
+            if (fields >> build >> scenario >> value)
+                baselines[{build, scenario}] = value;
+        }
+        return baselines;
+    }
+
+    void write_baselines(const Baselines &baselines)
+    {
+        std::ofstream out(NPC_SCALE_BASELINES);
+        out << "# <сборка> <сценарий> <NPC-тики/с с fight() / NPC-тики/с только сдвигов>;"
+               " обновление: NPC_SCALE_UPDATE=1 npc_scale_tests\n";
+        for (const auto &[key, value] : baselines)
+            out << key.first << ' ' << key.second << ' ' << value << '\n';
+    }
+
+    double throughput(const LoopResult &result)
+    {
+        return static_cast<double>(result.npc_ticks) / result.seconds;
+    }
+
+    class ScaleTest : public ::testing::TestWithParam<Scenario>
+    {
+    };
+
+    std::string scenario_name(const ::testing::TestParamInfo<Scenario> &info)
+    {
+        return info.param.name;
+    }
+}
+
+TEST_P(ScaleTest, FightLoopIdenticalAcrossThreadCounts)
+{
+    const Scenario scenario = GetParam();
+    const auto reference = run_fresh(scenario, nullptr);
+    size_t total_deaths = 0;
+    for (size_t deaths : reference.deaths)
+        total_deaths += deaths;
+    EXPECT_GT(total_deaths, 0u) << "сценарий без боёв ничего не проверяет";
+
+    for (size_t threads : THREAD_COUNTS)
+    {
+        ThreadPool pool(threads);
+        const auto result = run_fresh(scenario, &pool);
+        EXPECT_EQ(result.deaths, reference.deaths) << threads << " threads";
+        EXPECT_EQ(result.digest, reference.digest) << threads << " threads";
+    }
+}
+
+TEST_P(ScaleTest, PackedMovesAndTiledCandidatesIdenticalAcrossThreadCounts)
+{
+    const Scenario scenario = GetParam();
+    // Карта сжимается до предела int16 по x с растяжением по y: плотность та же.
+    Scenario packed_scenario = scenario;
+    const int width = std::min(scenario.width, PackedWorld::MAX_COORD + 1);
+    packed_scenario.height = static_cast<int>(static_cast<long long>(scenario.height) * scenario.width / width);
+    const auto world = make_world(packed_scenario, width);
+
+    // Параллельные части упакованного цикла; fight_packed последовательный
+    // и сверяется с fight() в npc_tests.
+    auto packed_run = [&](ThreadPool *pool)
+    {
+        auto stored = PackedWorld::from_store(world);
+        if (!stored)
+        {
+            ADD_FAILURE() << "world does not fit PackedWorld coordinates";
+            return std::uint64_t{0};
+        }
+        auto &packed = *stored;
+        for (size_t tick = 0; tick < scenario.ticks; ++tick)
+        {
+            const std::uint64_t tick_seed = counter_bits(SEED, tick);
+            if (pool)
+                move_packed(packed.records(), width - 1, packed_scenario.height - 1, tick_seed, *pool);
+            else
+                move_packed(packed.records(), width - 1, packed_scenario.height - 1, tick_seed);
+        }
+        std::uint64_t hash = 0;
+        for (const auto &record : packed.records())
+            mix(hash, (static_cast<std::uint64_t>(static_cast<std::uint16_t>(record.x)) << 24) |
+                          (static_cast<std::uint64_t>(static_cast<std::uint16_t>(record.y)) << 8) | record.meta);
+        return hash;
+    };
+
+    SpatialIndex index;
+    index.rebuild(world);
+    auto tiled = [&](ThreadPool &pool)
+    {
+        AdaptivePartitioner partition(pool.size() * 4);
+        std::vector<FightCandidate> candidates;
+        collect_candidates_tiled(world, index, partition, pool, candidates);
+        return candidates;
+    };
+
+    const std::uint64_t reference = packed_run(nullptr);
+    ThreadPool single(1);
+    const auto reference_candidates = tiled(single);
+    EXPECT_FALSE(reference_candidates.empty());
+    for (size_t threads : THREAD_COUNTS)
+    {
+        ThreadPool pool(threads);
+        EXPECT_EQ(packed_run(&pool), reference) << threads << " threads";
+        const auto candidates = tiled(pool);
+        ASSERT_EQ(candidates.size(), reference_candidates.size()) << threads << " threads";
+        for (size_t i = 0; i < candidates.size(); ++i)
+        {
+            ASSERT_EQ(candidates[i].attacker, reference_candidates[i].attacker) << threads << " threads, pair " << i;
+            ASSERT_EQ(candidates[i].defender, reference_candidates[i].defender) << threads << " threads, pair " << i;
+        }
+    }
+}
+
+TEST_P(ScaleTest, FightThroughputWithinBaseline)
+{
+    const Scenario scenario = GetParam();
+    // Прогоны чередуются, берётся лучший из трёх: шум планировщика только замедляет,
+    // а дрейф частоты машины задевает обе стороны одинаково.
+    double moves = 0.0;
+    double serial = 0.0;
+    for (int attempt = 0; attempt < 3; ++attempt)
+    {
+        moves = std::max(moves, throughput(run_fresh(scenario, nullptr, false)));
+        serial = std::max(serial, throughput(run_fresh(scenario, nullptr)));
+    }
+    const double share = serial / moves;
+    std::printf("%s: fight loop %.0f, moves only %.0f NPC-ticks/s, share %.4f\n", scenario.name, serial, moves, share);
+
+    auto baselines = read_baselines();
+    const auto key = std::make_pair(build_name(), std::string(scenario.name));
+    if (updating())
+    {
+        baselines[key] = share;
+        write_baselines(baselines);
+        return;
+    }
+    const auto found = baselines.find(key);
+    if (found == baselines.end())
+        GTEST_SKIP() << "no baseline for " << key.first << ' ' << key.second << " (share " << share
+                     << "); record with NPC_SCALE_UPDATE=1";
+    EXPECT_GE(share, found->second * tolerance()) << scenario.name << ": share " << share << ", baseline "
+                                                  << found->second << ", tolerance " << tolerance();
+}
+
+TEST_P(ScaleTest, PooledThroughputKeepsUpWithSerialOnLargeWorlds)
+{
+    const Scenario scenario = GetParam();
+    if (scenario.npcs < POOL_GATE_NPCS)
+        GTEST_SKIP() << scenario.name << ": pool overhead outweighs the work";
+    ThreadPool pool(4);
+    double serial = 0.0;
+    double pooled = 0.0;
+    for (int attempt = 0; attempt < 3; ++attempt)
+    {
+        serial = std::max(serial, throughput(run_fresh(scenario, nullptr)));
+        pooled = std::max(pooled, throughput(run_fresh(scenario, &pool)));
+    }
+    std::printf("%s: serial %.0f, pool4 %.0f NPC-ticks/s (x%.2f)\n", scenario.name, serial, pooled, pooled / serial);
+    EXPECT_GE(pooled, serial * tolerance()) << scenario.name << ": pool4 " << pooled << " NPC-ticks/s, serial "
+                                            << serial << ", tolerance " << tolerance();
+}
+
+INSTANTIATE_TEST_SUITE_P(Scenarios, ScaleTest, ::testing::ValuesIn(SCENARIOS), scenario_name);
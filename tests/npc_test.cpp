@@ -1,11 +1,50 @@
 #include "../include/battle.h"
+#include "../include/behaviour.h"
+#include "../include/delta_save.h"
+#include "../include/density.h"
 #include "../include/druid.h"
+#include "../include/format.h"
+#include "../include/loader.h"
+#include "../include/locality.h"
+#include "../include/monte_carlo.h"
+#include "../include/movement.h"
+#include "../include/neighbours.h"
+#include "../include/npc_store.h"
+#include "../include/observers.h"
+#include "../include/packed.h"
+#include "../include/pacing.h"
+#include "../include/partition.h"
+#include "../include/placement.h"
+#include "../include/resolver.h"
+#include "../include/rules.h"
+#include "../include/snapshot_server.h"
+#include "../include/spatial.h"
+#include "../include/thread_pool.h"
+#include "../include/timer_wheel.h"
+#include "../include/trace.h"
 
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
 #include <filesystem>
+#include <fstream>
+#include <iterator>
 #include <memory>
+#include <random>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
 #include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
 
 class CounterObserver : public IFightObserver
 {
@@ -385,3 +424,1663 @@ TEST(Fight, SquirrelCannotKillOrk)
     EXPECT_TRUE(dead.empty());
     EXPECT_EQ(observer->count, 0u);
 }
+
+TEST(NpcStore, StableIdsAndGenerations)
+{
+    std::vector<std::shared_ptr<IFightObserver>> observers;
+    NpcStore store;
+    auto ork = factory(OrkType, "st_ork", 0, 0, observers);
+    auto druid = factory(DruidType, "st_dr", 1, 1, observers);
+    auto squirrel = factory(SquirrelType, "st_sq", 2, 2, observers);
+
+    const auto ork_id = store.insert(ork).first;
+    const auto druid_id = store.insert(druid).first;
+    const auto squirrel_id = store.insert(squirrel).first;
+
+    EXPECT_FALSE(store.insert(ork).second);
+    ASSERT_EQ(store.size(), 3u);
+
+    EXPECT_TRUE(store.erase(ork_id));
+    EXPECT_FALSE(store.contains(ork_id));
+    EXPECT_EQ(store.get(ork_id), nullptr);
+    EXPECT_EQ(store.get(druid_id), druid);
+    EXPECT_EQ(store.get(squirrel_id), squirrel);
+
+    auto reused = store.insert(factory(OrkType, "st_ork2", 3, 3, observers)).first;
+    EXPECT_EQ(reused.index, ork_id.index);
+    EXPECT_NE(reused.generation, ork_id.generation);
+    EXPECT_FALSE(store.contains(ork_id));
+}
+
+TEST(NpcStore, IterationFollowsInsertionOrder)
+{
+    std::vector<std::shared_ptr<IFightObserver>> observers;
+    NpcStore store;
+    for (int i = 0; i < 5; ++i)
+        store.insert(factory(OrkType, "ord_" + std::to_string(i), i, i, observers));
+
+    int expected = 0;
+    for (const auto &npc : store)
+        EXPECT_EQ(npc->get_name(), "ord_" + std::to_string(expected++));
+
+    store.erase(store[1]);
+    EXPECT_EQ(store[1]->get_name(), "ord_4");
+    EXPECT_EQ(store.size(), 4u);
+}
+
+class AnyFightObserver : public IFightObserver
+{
+public:
+    void on_fight(const std::shared_ptr<NPC>, const std::shared_ptr<NPC>, bool) override { ++calls; }
+
+    size_t calls{0};
+};
+
+TEST(Fight, ImpossiblePairsAreNotNotified)
+{
+    auto observer = std::make_shared<AnyFightObserver>();
+    std::vector<std::shared_ptr<IFightObserver>> observers{observer};
+
+    set_t npcs;
+    npcs.insert(factory(SquirrelType, "prune_sq", 0, 0, observers));
+    npcs.insert(factory(OrkType, "prune_ork1", 1, 1, observers));
+    npcs.insert(factory(OrkType, "prune_ork2", 2, 2, observers));
+    npcs.insert(factory(DruidType, "prune_dr", 80, 80, observers));
+
+    auto dead = fight(npcs, 5);
+    EXPECT_TRUE(dead.empty());
+    EXPECT_EQ(observer->calls, 0u);
+}
+
+TEST(Fight, EachPredatorPreyPairResolvedOnce)
+{
+    auto observer = std::make_shared<AnyFightObserver>();
+    std::vector<std::shared_ptr<IFightObserver>> observers{observer};
+
+    set_t npcs;
+    npcs.insert(factory(DruidType, "once_dr", 0, 0, observers));
+    npcs.insert(factory(OrkType, "once_ork", 1, 0, observers));
+    npcs.insert(factory(SquirrelType, "once_sq", 0, 1, observers));
+
+    fight(npcs, 5);
+    EXPECT_GE(observer->calls, 1u);
+    EXPECT_LE(observer->calls, 2u);
+}
+
+TEST(Fight, KillRatePerPairIsOneRollFromThePredatorSide)
+{
+    // Изолированные пары далеко друг от друга: за раунд хищник бросает один раз,
+    // жертва гибнет с вероятностью P(attack > defense) = 15/36.
+    constexpr int PAIRS = 4000;
+    auto kill_rate = [](NpcType predator, NpcType prey, unsigned seed)
+    {
+        std::vector<std::shared_ptr<IFightObserver>> observers;
+        set_t npcs;
+        for (int i = 0; i < PAIRS; ++i)
+        {
+            npcs.insert(factory(predator, "p" + std::to_string(i), i * 100, 0, observers));
+            npcs.insert(factory(prey, "q" + std::to_string(i), i * 100 + 1, 0, observers));
+        }
+        seed_random(seed);
+        const auto dead = fight(npcs, 5);
+        for (const auto &npc : dead)
+            EXPECT_EQ(npc->get_type(), prey);
+        return static_cast<double>(dead.size()) / PAIRS;
+    };
+
+    const double p = 15.0 / 36.0;
+    const double sigma = std::sqrt(p * (1 - p) / PAIRS);
+    const double ork_druid = kill_rate(OrkType, DruidType, 11);
+    const double druid_squirrel = kill_rate(DruidType, SquirrelType, 12);
+    EXPECT_NEAR(ork_druid, p, 4 * sigma);
+    EXPECT_NEAR(druid_squirrel, p, 4 * sigma);
+    // Второй бросок из прежнего перебора дал бы ~0.66 — далеко за пределами допуска.
+    EXPECT_LT(ork_druid, 1 - (21.0 / 36.0) * (21.0 / 36.0) - 10 * sigma);
+    // Пары без права атаки не дерутся.
+    EXPECT_EQ(kill_rate(OrkType, SquirrelType, 13), 0.0);
+    EXPECT_EQ(kill_rate(OrkType, OrkType, 14), 0.0);
+}
+
+TEST(Behaviour, WanderStaysInBoundsAndEndsOnDeath)
+{
+    std::vector<std::shared_ptr<IFightObserver>> observers;
+    BehaviourScheduler scheduler(100, 100, 7);
+    std::vector<std::shared_ptr<NPC>> npcs;
+    for (int i = 0; i < 1000; ++i)
+    {
+        npcs.push_back(factory(OrkType, "w" + std::to_string(i), 50, 50, observers));
+        scheduler.spawn(wander(npcs.back(), scheduler.context()));
+    }
+
+    for (int t = 0; t < 20; ++t)
+        scheduler.tick();
+    for (const auto &npc : npcs)
+    {
+        EXPECT_GE(npc->get_x(), 0);
+        EXPECT_LE(npc->get_x(), 100);
+        EXPECT_GE(npc->get_y(), 0);
+        EXPECT_LE(npc->get_y(), 100);
+    }
+
+    for (auto &npc : npcs)
+        npc->die();
+    scheduler.tick();
+    scheduler.tick();
+    EXPECT_EQ(scheduler.size(), 0u);
+}
+
+TEST(Behaviour, ChaseClosesDistanceAndFleeOpensIt)
+{
+    std::vector<std::shared_ptr<IFightObserver>> observers;
+    BehaviourScheduler scheduler(100, 100, 7);
+    auto ork = factory(OrkType, "chaser", 0, 0, observers);
+    auto druid = factory(DruidType, "target", 60, 40, observers);
+    auto squirrel = factory(SquirrelType, "runner", 50, 50, observers);
+    auto hunter = factory(DruidType, "hunter", 45, 50, observers);
+
+    scheduler.spawn(chase(ork, scheduler.context(), druid));
+    scheduler.spawn(flee(squirrel, scheduler.context(), hunter));
+    for (int t = 0; t < 5; ++t)
+        scheduler.tick();
+
+    EXPECT_EQ(ork->position(), std::make_pair(60, 40));
+    EXPECT_EQ(squirrel->position(), std::make_pair(75, 50));
+}
+
+TEST(Behaviour, PatrolVisitsWaypointsAndSleepSkipsTicks)
+{
+    std::vector<std::shared_ptr<IFightObserver>> observers;
+    BehaviourScheduler scheduler(100, 100, 7);
+    auto squirrel = factory(SquirrelType, "patroller", 0, 0, observers);
+    scheduler.spawn(patrol(squirrel, scheduler.context(), {{10, 0}, {10, 10}}));
+
+    scheduler.tick();
+    scheduler.tick();
+    EXPECT_EQ(squirrel->position(), std::make_pair(10, 0));
+    scheduler.tick();
+    scheduler.tick();
+    scheduler.tick();
+    EXPECT_EQ(squirrel->position(), std::make_pair(10, 10));
+
+    auto counter = std::make_shared<int>(0);
+    auto sleeper = [](std::shared_ptr<int> c) -> Behaviour
+    {
+        for (;;)
+        {
+            ++*c;
+            co_await sleep_ticks(2);
+        }
+    };
+    scheduler.spawn(sleeper(counter));
+    for (int t = 0; t < 6; ++t)
+        scheduler.tick();
+    EXPECT_EQ(*counter, 2);
+    EXPECT_GT(FramePool::reserved_bytes(), 0u);
+}
+
+TEST(Behaviour, MillionBehavioursFitFrameBudget)
+{
+    auto npc = factory(OrkType, "budget_ork", 5, 5, {});
+    set_t prey;
+    SpatialIndex index;
+    index.rebuild(prey);
+
+    constexpr size_t COUNT = 1000000;
+    const size_t before = FramePool::reserved_bytes();
+    {
+        BehaviourScheduler scheduler(100, 100, 3);
+        scheduler.reserve(COUNT);
+        for (size_t i = 0; i < COUNT; ++i)
+            scheduler.spawn(i % 2 ? hunt(npc, scheduler.context(), index, prey) : wander(npc, scheduler.context()));
+        scheduler.tick();
+        EXPECT_EQ(scheduler.size(), COUNT);
+        const double per_behaviour = static_cast<double>(FramePool::reserved_bytes() - before) / COUNT;
+        EXPECT_LE(per_behaviour, static_cast<double>(FramePool::FRAME_BUDGET));
+    }
+
+    // Кадры, выделенные в другом потоке и освобождённые здесь, переиспользуются без новых чанков.
+    std::vector<Behaviour> frames;
+    BehaviourScheduler owner(100, 100, 4);
+    std::thread producer([&]()
+                         {
+        for (int i = 0; i < 20000; ++i)
+            frames.push_back(wander(npc, owner.context())); });
+    producer.join();
+    frames.clear();
+    const size_t reused = FramePool::reserved_bytes();
+    for (int i = 0; i < 20000; ++i)
+        frames.push_back(wander(npc, owner.context()));
+    EXPECT_EQ(FramePool::reserved_bytes(), reused);
+}
+
+TEST(Spatial, MatchesBruteForceWithTypeFilters)
+{
+    std::vector<std::shared_ptr<IFightObserver>> observers;
+    std::mt19937 rng(3);
+    std::uniform_int_distribution<int> coord(0, 500);
+    std::uniform_int_distribution<int> type(1, 3);
+
+    set_t npcs;
+    for (int i = 0; i < 10000; ++i)
+        npcs.insert(factory(static_cast<NpcType>(type(rng)), "sp" + std::to_string(i), coord(rng), coord(rng), observers));
+
+    ThreadPool pool(4);
+    SpatialIndex parallel_index;
+    SpatialIndex serial_index;
+    parallel_index.rebuild(npcs, &pool);
+    serial_index.rebuild(npcs);
+    ASSERT_EQ(parallel_index.size(), npcs.size());
+
+    const TypeMask druids = type_mask(DruidType);
+    EXPECT_EQ(prey_mask(OrkType), druids);
+    EXPECT_EQ(predator_mask(SquirrelType), druids);
+
+    std::vector<SpatialHit> knn;
+    std::vector<SpatialHit> around;
+    for (int q = 0; q < 50; ++q)
+    {
+        const int qx = coord(rng);
+        const int qy = coord(rng);
+
+        std::vector<SpatialHit> expected;
+        for (size_t i = 0; i < npcs.size(); ++i)
+        {
+            if (npcs[i]->get_type() != DruidType)
+                continue;
+            const long long dx = npcs[i]->get_x() - qx;
+            const long long dy = npcs[i]->get_y() - qy;
+            expected.push_back({i, dx * dx + dy * dy});
+        }
+        std::sort(expected.begin(), expected.end(), [](const SpatialHit &a, const SpatialHit &b)
+                  { return a.distance2 < b.distance2 || (a.distance2 == b.distance2 && a.index < b.index); });
+
+        for (const SpatialIndex *index : {&parallel_index, &serial_index})
+        {
+            index->k_nearest(qx, qy, 5, druids, knn);
+            ASSERT_EQ(knn.size(), 5u);
+            for (size_t i = 0; i < knn.size(); ++i)
+            {
+                EXPECT_EQ(knn[i].index, expected[i].index);
+                EXPECT_EQ(knn[i].distance2, expected[i].distance2);
+            }
+
+            index->within_radius(qx, qy, 20, druids, around);
+            const auto inside = std::count_if(expected.begin(), expected.end(), [](const SpatialHit &h)
+                                              { return h.distance2 <= 400; });
+            EXPECT_EQ(around.size(), static_cast<size_t>(inside));
+        }
+    }
+}
+
+TEST(Spatial, HuntMovesTowardNearestPrey)
+{
+    std::vector<std::shared_ptr<IFightObserver>> observers;
+    set_t npcs;
+    auto ork = factory(OrkType, "hunter_ork", 50, 50, observers);
+    auto near_druid = factory(DruidType, "near", 60, 50, observers);
+    npcs.insert(ork);
+    npcs.insert(factory(DruidType, "far", 0, 0, observers));
+    npcs.insert(near_druid);
+    npcs.insert(factory(SquirrelType, "decoy", 51, 51, observers));
+
+    SpatialIndex index;
+    index.rebuild(npcs);
+    auto hit = index.nearest(50, 50, prey_mask(OrkType));
+    ASSERT_TRUE(hit);
+    EXPECT_EQ(npcs[hit->index], near_druid);
+
+    BehaviourScheduler scheduler(100, 100, 1);
+    scheduler.spawn(hunt(ork, scheduler.context(), index, npcs));
+    scheduler.tick();
+    EXPECT_EQ(ork->position(), std::make_pair(60, 50));
+}
+
+class BatchObserver : public IFightObserver
+{
+public:
+    void on_fight(const std::shared_ptr<NPC>, const std::shared_ptr<NPC>, bool) override { ++single_calls; }
+    void on_fights(const NpcStore &, std::span<const FightOutcome> outcomes) override
+    {
+        ++batches;
+        total += outcomes.size();
+    }
+
+    size_t single_calls{0};
+    size_t batches{0};
+    size_t total{0};
+};
+
+TEST(Resolver, DiceBatchIsDeterministicAndInRange)
+{
+    std::vector<std::uint8_t> a1(10000), d1(10000), a2(10000), d2(10000);
+    roll_dice_batch(42, a1, d1);
+    roll_dice_batch(42, a2, d2);
+    EXPECT_EQ(a1, a2);
+    EXPECT_EQ(d1, d2);
+
+    std::array<size_t, 7> histogram{};
+    for (size_t i = 0; i < a1.size(); ++i)
+    {
+        ASSERT_GE(a1[i], 1);
+        ASSERT_LE(a1[i], 6);
+        ASSERT_GE(d1[i], 1);
+        ASSERT_LE(d1[i], 6);
+        ++histogram[a1[i]];
+    }
+    for (int face = 1; face <= 6; ++face)
+        EXPECT_NEAR(static_cast<double>(histogram[face]), 10000.0 / 6, 200.0);
+}
+
+TEST(Resolver, SweepRespectsDeathsAndBatchesObservers)
+{
+    auto observer = std::make_shared<BatchObserver>();
+    std::vector<std::shared_ptr<IFightObserver>> observers{observer};
+    const std::vector<FightCandidate> candidates{{0, 2}, {1, 2}, {2, 3}};
+    for (std::uint64_t seed = 0; seed < 64; ++seed)
+    {
+        set_t fresh;
+        fresh.insert(factory(OrkType, "rs_ork1", 0, 0, observers));
+        fresh.insert(factory(OrkType, "rs_ork2", 0, 0, observers));
+        fresh.insert(factory(DruidType, "rs_dr", 0, 0, observers));
+        fresh.insert(factory(SquirrelType, "rs_sq", 0, 0, observers));
+
+        FightResolver resolver;
+        resolver.resolve(fresh, candidates, seed);
+        size_t druid_deaths = 0;
+        bool druid_attacked_after_death = false;
+        bool druid_dead = false;
+        for (const auto &outcome : resolver.outcomes())
+        {
+            if (outcome.attacker == 2)
+                druid_attacked_after_death = druid_attacked_after_death || druid_dead;
+            if (outcome.defender == 2 && outcome.win)
+            {
+                ++druid_deaths;
+                druid_dead = true;
+            }
+        }
+        EXPECT_LE(druid_deaths, 1u);
+        EXPECT_FALSE(druid_attacked_after_death);
+        EXPECT_EQ(fresh[2]->is_alive(), druid_deaths == 0);
+
+        const size_t batches_before = observer->batches;
+        resolver.notify(fresh);
+        EXPECT_EQ(observer->batches, batches_before + (resolver.outcomes().empty() ? 0 : 1));
+    }
+    EXPECT_EQ(observer->single_calls, 0u);
+}
+
+TEST(Printing, FormattingHonoursTargetStream)
+{
+    std::vector<std::shared_ptr<IFightObserver>> observers;
+    set_t npcs;
+    npcs.insert(factory(OrkType, "fmt_ork", -3, 40, observers));
+    npcs.insert(factory(DruidType, "fmt_dr", 7, 0, observers));
+
+    std::ostringstream roster;
+    roster << npcs;
+    EXPECT_EQ(roster.str(), "Ork fmt_ork (-3, 40)\nDruid fmt_dr (7, 0)\n");
+
+    std::ostringstream all;
+    print_all(npcs, all);
+    EXPECT_EQ(all.str(), "Ork fmt_ork {-3, 40}\nDruid fmt_dr {7, 0}\n");
+
+    std::ostringstream single;
+    single << *npcs[1];
+    EXPECT_EQ(single.str(), "Druid fmt_dr {7, 0}");
+
+    std::string buffer;
+    buffer.reserve(256);
+    const auto *data = buffer.data();
+    append_npc(buffer, *npcs[0]);
+    append_npc_line(buffer, *npcs[1]);
+    EXPECT_EQ(buffer, "Ork fmt_ork {-3, 40}Druid fmt_dr (7, 0)\n");
+    EXPECT_EQ(buffer.data(), data);
+}
+
+TEST(Observer, SummaryAggregatesAndSamples)
+{
+    std::ostringstream out;
+    {
+        auto summary = std::make_shared<SummaryConsoleObserver>(
+            ConsoleSummaryOptions{std::chrono::hours(1), 2, &out});
+        std::vector<std::shared_ptr<IFightObserver>> observers{summary};
+        set_t npcs;
+        npcs.insert(factory(OrkType, "sum_ork", 0, 0, observers));
+        npcs.insert(factory(DruidType, "sum_dr1", 1, 1, observers));
+        npcs.insert(factory(DruidType, "sum_dr2", 2, 2, observers));
+        npcs.insert(factory(SquirrelType, "sum_sq", 3, 3, observers));
+
+        const std::vector<FightOutcome> outcomes{{0, 1, true}, {0, 2, true}, {2, 3, true}, {0, 2, false}};
+        summary->on_fights(npcs, outcomes);
+        EXPECT_TRUE(out.str().empty());
+
+        summary->flush();
+        const auto text = out.str();
+        EXPECT_NE(text.find("Murders: 3"), std::string::npos);
+        EXPECT_NE(text.find("Ork -> Druid: 2"), std::string::npos);
+        EXPECT_NE(text.find("Druid -> Squirrel: 1"), std::string::npos);
+        EXPECT_NE(text.find("e.g. Ork sum_ork {0, 0} -> Druid sum_dr1 {1, 1}"), std::string::npos);
+        EXPECT_EQ(text.find("sum_sq"), std::string::npos);
+
+        out.str("");
+        summary->flush();
+        EXPECT_TRUE(out.str().empty());
+    }
+    EXPECT_TRUE(out.str().empty());
+}
+
+namespace
+{
+    set_t make_random_world(size_t count, int side, unsigned int seed,
+                            const std::vector<std::shared_ptr<IFightObserver>> &observers)
+    {
+        std::mt19937 rng(seed);
+        std::uniform_int_distribution<int> coord(0, side);
+        std::uniform_int_distribution<int> type(1, 3);
+        set_t npcs;
+        npcs.reserve(count);
+        for (size_t i = 0; i < count; ++i)
+            npcs.insert(factory(static_cast<NpcType>(type(rng)), "w" + std::to_string(i), coord(rng), coord(rng), observers));
+        return npcs;
+    }
+
+    std::vector<std::string> sorted_names(const set_t &npcs)
+    {
+        std::vector<std::string> names;
+        for (const auto &npc : npcs)
+            names.push_back(npc->get_name());
+        std::sort(names.begin(), names.end());
+        return names;
+    }
+}
+
+TEST(Fight, ParallelMatchesSequentialForFixedSeed)
+{
+    auto seq_observer = std::make_shared<CounterObserver>();
+    auto par_observer = std::make_shared<CounterObserver>();
+    auto sequential_world = make_random_world(5000, 300, 11, {seq_observer});
+    auto parallel_world = make_random_world(5000, 300, 11, {par_observer});
+
+    ThreadPool pool(4);
+    for (int round = 0; round < 3; ++round)
+    {
+        seed_random(100 + round);
+        const auto sequential_dead = fight(sequential_world, 10);
+        seed_random(100 + round);
+        const auto parallel_dead = fight(parallel_world, 10, pool);
+
+        ASSERT_FALSE(sequential_dead.empty());
+        EXPECT_EQ(sorted_names(sequential_dead), sorted_names(parallel_dead));
+    }
+    EXPECT_EQ(seq_observer->count, par_observer->count);
+}
+
+TEST(Locality, MortonSortKeepsIdsStable)
+{
+    std::vector<std::shared_ptr<IFightObserver>> observers;
+    auto npcs = make_random_world(2000, 1000, 5, observers);
+
+    std::vector<std::pair<NpcId, std::string>> ids;
+    for (size_t i = 0; i < npcs.size(); ++i)
+        ids.emplace_back(npcs.id_at(i), npcs[i]->get_name());
+
+    EXPECT_GT(morton_disorder(npcs), 0.3);
+    const auto version = npcs.layout_version();
+    EXPECT_TRUE(resort_if_disordered(npcs, 0.25));
+    EXPECT_NE(npcs.layout_version(), version);
+    EXPECT_EQ(morton_disorder(npcs), 0.0);
+    EXPECT_FALSE(resort_if_disordered(npcs, 0.25));
+
+    for (size_t i = 1; i < npcs.size(); ++i)
+        EXPECT_LE(morton_key(npcs[i - 1]->get_x(), npcs[i - 1]->get_y()), morton_key(npcs[i]->get_x(), npcs[i]->get_y()));
+    for (const auto &[id, name] : ids)
+    {
+        ASSERT_TRUE(npcs.contains(id));
+        EXPECT_EQ(npcs.get(id)->get_name(), name);
+        EXPECT_EQ(npcs[npcs.dense_index(id)], npcs.get(id));
+    }
+    EXPECT_EQ(morton_key(3, 5), 0b100111u);
+}
+
+TEST(Neighbours, CachedListsMatchBruteForce)
+{
+    std::vector<std::shared_ptr<IFightObserver>> observers;
+    auto npcs = make_random_world(600, 300, 9, observers);
+    std::mt19937 rng(2);
+
+    SpatialIndex index;
+    NeighbourList neighbours(20);
+    std::vector<FightCandidate> cached;
+    const int ticks = 40;
+    for (int tick = 0; tick < ticks; ++tick)
+    {
+        for (const auto &npc : npcs)
+        {
+            std::uniform_int_distribution<int> shift(-1, 1);
+            npc->move(shift(rng), shift(rng), 300, 300);
+        }
+        index.rebuild(npcs);
+        neighbours.update(npcs, index);
+
+        cached.clear();
+        neighbours.collect_candidates(npcs, cached);
+
+        std::vector<std::pair<std::uint32_t, std::uint32_t>> expected;
+        for (size_t i = 0; i < npcs.size(); ++i)
+            for (size_t j = 0; j < npcs.size(); ++j)
+                if (can_attack(npcs[i]->get_type(), npcs[j]->get_type()) &&
+                    npcs[i]->is_close(npcs[j], static_cast<size_t>(rules_for(npcs[i]->get_type()).kill_distance)))
+                    expected.emplace_back(static_cast<std::uint32_t>(i), static_cast<std::uint32_t>(j));
+
+        std::vector<std::pair<std::uint32_t, std::uint32_t>> actual;
+        for (const auto &c : cached)
+            actual.emplace_back(c.attacker, c.defender);
+        std::sort(actual.begin(), actual.end());
+        ASSERT_EQ(actual, expected) << "tick " << tick;
+    }
+    EXPECT_LT(neighbours.rebuilds(), static_cast<size_t>(ticks) / 2);
+}
+
+TEST(Neighbours, PerTypeSlackStaysExactAtFullStepsAndRebuildsLessThanUniformSkin)
+{
+    std::vector<std::shared_ptr<IFightObserver>> observers;
+    auto npcs = make_random_world(400, 300, 5, observers);
+    std::mt19937 rng(8);
+
+    SpatialIndex index;
+    auto per_type = NeighbourList::for_ticks(3);
+    NeighbourList uniform(10);
+    std::vector<FightCandidate> cached;
+    const int ticks = 30;
+    for (int tick = 0; tick < ticks; ++tick)
+    {
+        // Каждый NPC шагает на полный шаг своего типа, как Ork в main.
+        for (const auto &npc : npcs)
+        {
+            const int step = rules_for(npc->get_type()).step;
+            std::uniform_int_distribution<int> shift(-step, step);
+            npc->move(shift(rng), shift(rng), 300, 300);
+        }
+        index.rebuild(npcs);
+        per_type.update(npcs, index);
+        uniform.update(npcs, index);
+
+        cached.clear();
+        per_type.collect_candidates(npcs, cached);
+        std::vector<std::pair<std::uint32_t, std::uint32_t>> expected;
+        for (size_t i = 0; i < npcs.size(); ++i)
+            for (size_t j = 0; j < npcs.size(); ++j)
+                if (can_attack(npcs[i]->get_type(), npcs[j]->get_type()) &&
+                    npcs[i]->is_close(npcs[j], static_cast<size_t>(rules_for(npcs[i]->get_type()).kill_distance)))
+                    expected.emplace_back(static_cast<std::uint32_t>(i), static_cast<std::uint32_t>(j));
+        std::vector<std::pair<std::uint32_t, std::uint32_t>> actual;
+        for (const auto &c : cached)
+            actual.emplace_back(c.attacker, c.defender);
+        std::sort(actual.begin(), actual.end());
+        ASSERT_EQ(actual, expected) << "tick " << tick;
+    }
+    // Запас в skin / 2 = 5 меньше шага Ork: общий список перестраивается каждый тик.
+    EXPECT_EQ(uniform.rebuilds(), static_cast<size_t>(ticks));
+    EXPECT_LT(per_type.rebuilds(), static_cast<size_t>(ticks) / 2);
+}
+
+TEST(Packed, RoundTripAndFightMatchObjectWorld)
+{
+    std::vector<std::shared_ptr<IFightObserver>> observers;
+    auto npcs = make_random_world(3000, 250, 21, observers);
+    npcs[7]->die();
+
+    auto stored = PackedWorld::from_store(npcs);
+    ASSERT_TRUE(stored);
+    auto &packed = *stored;
+    ASSERT_EQ(packed.size(), npcs.size());
+    for (size_t i = 0; i < npcs.size(); ++i)
+        EXPECT_EQ(packed.name(static_cast<std::uint32_t>(i)), npcs[i]->get_name());
+    EXPECT_EQ(packed.records()[5].x, npcs[5]->get_x());
+    EXPECT_EQ(packed.records()[5].type(), npcs[5]->get_type());
+    EXPECT_FALSE(packed.records()[7].alive());
+    EXPECT_LT(packed.memory_bytes(), npcs.size() * 24);
+
+    seed_random(77);
+    const auto seed = draw_seed();
+    std::vector<FightOutcome> packed_outcomes;
+    fight_packed(packed, 10, seed, packed_outcomes);
+
+    seed_random(77);
+    const auto dead = fight(npcs, 10);
+
+    size_t packed_kills = 0;
+    for (const auto &outcome : packed_outcomes)
+    {
+        if (!outcome.win)
+            continue;
+        ++packed_kills;
+        EXPECT_TRUE(dead.contains(npcs[outcome.defender]));
+    }
+    EXPECT_EQ(packed_kills, dead.size());
+    for (size_t i = 0; i < npcs.size(); ++i)
+        EXPECT_EQ(packed.records()[i].alive(), npcs[i]->is_alive());
+
+    packed.records()[0].x = -4;
+    packed.apply_to(npcs);
+    EXPECT_EQ(npcs[0]->get_x(), -4);
+}
+
+TEST(Packed, RejectsCoordinatesOutsideInt16)
+{
+    PackedWorld world;
+    EXPECT_TRUE(world.add(OrkType, "edge", PackedWorld::MAX_COORD, PackedWorld::MIN_COORD));
+    EXPECT_FALSE(world.add(OrkType, "far_x", PackedWorld::MAX_COORD + 1, 0));
+    EXPECT_FALSE(world.add(OrkType, "far_y", 0, PackedWorld::MIN_COORD - 1));
+    EXPECT_FALSE(world.add(OrkType, std::string(PackedWorld::MAX_NAME + 1, 'n'), 0, 0));
+    ASSERT_EQ(world.size(), 1u);
+    EXPECT_EQ(world.name(0), "edge");
+    EXPECT_EQ(world.records()[0].x, PackedWorld::MAX_COORD);
+
+    std::vector<std::shared_ptr<IFightObserver>> observers;
+    set_t npcs;
+    npcs.insert(factory(SquirrelType, "near", 10, 10, observers));
+    npcs.insert(factory(DruidType, "far", 40000, 10, observers));
+    EXPECT_FALSE(PackedWorld::from_store(npcs));
+    npcs[1]->set_position(32767, 10);
+    EXPECT_TRUE(PackedWorld::from_store(npcs));
+}
+
+TEST(Movement, PackedKernelRespectsStepsBoundsAndDeath)
+{
+    PackedWorld world;
+    for (int i = 0; i < 200000; ++i)
+        world.add(static_cast<NpcType>(1 + i % 3), "", i % 101, i % 97);
+    world.kill(4);
+    auto parallel = world;
+
+    const std::vector<NpcHot> before(world.records().begin(), world.records().end());
+    move_packed(world.records(), 100, 100, 5);
+    ThreadPool pool(3);
+    move_packed(parallel.records(), 100, 100, 5, pool);
+
+    size_t moved = 0;
+    for (size_t i = 0; i < before.size(); ++i)
+    {
+        const auto &was = before[i];
+        const auto &now = world.records()[i];
+        const int step = rules_for(was.type()).step;
+        ASSERT_LE(std::abs(now.x - was.x), step);
+        ASSERT_LE(std::abs(now.y - was.y), step);
+        ASSERT_GE(now.x, 0);
+        ASSERT_LE(now.x, 100);
+        ASSERT_GE(now.y, 0);
+        ASSERT_LE(now.y, 100);
+        ASSERT_EQ(now.meta, was.meta);
+        ASSERT_EQ(now.x, parallel.records()[i].x);
+        ASSERT_EQ(now.y, parallel.records()[i].y);
+        moved += now.x != was.x || now.y != was.y;
+    }
+    EXPECT_EQ(world.records()[4].x, before[4].x);
+    EXPECT_EQ(world.records()[4].y, before[4].y);
+    EXPECT_GT(moved, before.size() * 3 / 4);
+}
+
+TEST(Pacing, DetectionSpreadsWhenOverBudgetAndReportsPercentiles)
+{
+    using namespace std::chrono_literals;
+    TickPacer pacer(2ms, 0.5, 8);
+
+    std::vector<bool> covered(100, false);
+    for (int tick = 0; tick < 6; ++tick)
+    {
+        pacer.begin_tick();
+        const auto [begin, end] = pacer.detection_slice(100);
+        for (size_t i = begin; i < end; ++i)
+            covered[i] = true;
+        std::this_thread::sleep_for(3ms);
+        pacer.end_detection();
+        pacer.finish_tick();
+    }
+    EXPECT_EQ(pacer.detection_slices(), 8u);
+
+    std::fill(covered.begin(), covered.end(), false);
+    for (int tick = 0; tick < 8; ++tick)
+    {
+        pacer.begin_tick();
+        const auto [begin, end] = pacer.detection_slice(100);
+        for (size_t i = begin; i < end; ++i)
+            covered[i] = true;
+        pacer.finish_tick();
+    }
+    EXPECT_TRUE(std::all_of(covered.begin(), covered.end(), [](bool c)
+                            { return c; }));
+
+    const auto stats = pacer.stats();
+    EXPECT_EQ(stats.ticks, 14u);
+    EXPECT_GE(stats.overruns, 6u);
+    EXPECT_GE(stats.p99, stats.p50);
+    EXPECT_GE(stats.p99, std::chrono::microseconds(3000));
+
+    for (int tick = 0; tick < 6; ++tick)
+    {
+        pacer.begin_tick();
+        pacer.detection_slice(100);
+        pacer.end_detection();
+        pacer.finish_tick();
+    }
+    EXPECT_EQ(pacer.detection_slices(), 1u);
+}
+
+TEST(MonteCarlo, HistogramIndependentOfThreads)
+{
+    WorldParams params;
+    params.npcs = 40;
+    params.ticks = 200;
+
+    ThreadPool single(0);
+    ThreadPool several(3);
+    BatchRunner a(single, params);
+    BatchRunner b(several, params);
+    const auto ha = a.run(24, 7);
+    const auto hb = b.run(24, 7);
+
+    EXPECT_EQ(ha.runs, 24u);
+    for (size_t type = 0; type < NPC_TYPE_COUNT; ++type)
+        EXPECT_EQ(ha.counts[type], hb.counts[type]);
+
+    // Прогон в переиспользованных буферах совпадает с прогоном с нуля.
+    for (size_t r = 0; r < 24; ++r)
+    {
+        const auto fresh = run_world(params, counter_bits(7, r));
+        EXPECT_EQ(a.results()[r].survivors, fresh.survivors);
+        EXPECT_EQ(b.results()[r].initial, fresh.initial);
+
+        size_t initial = 0;
+        for (size_t type = 0; type < NPC_TYPE_COUNT; ++type)
+        {
+            initial += fresh.initial[type];
+            EXPECT_LE(fresh.survivors[type], fresh.initial[type]);
+        }
+        EXPECT_EQ(initial, params.npcs);
+        // Орков никто не ест.
+        EXPECT_EQ(fresh.survivors[OrkType], fresh.initial[OrkType]);
+    }
+}
+
+TEST(Loader, ReportsBadLinesWithLineNumbers)
+{
+    const std::string text = "5\n"
+                             "1 ork_a 1 2\n"
+                             "7 alien 3 4\n"
+                             "\n"
+                             "2 sq_b 5 x\n"
+                             "3 dr_c -6 7\r\n"
+                             "2\n"
+                             "1 ork_d 8 9 extra\n";
+    ThreadPool pool(2);
+    std::vector<NpcRecord> records;
+    std::vector<LoadError> errors;
+    EXPECT_EQ(parse_npc_records(text, pool, records, errors), 5u);
+
+    ASSERT_EQ(records.size(), 2u);
+    EXPECT_EQ(records[0].type, OrkType);
+    EXPECT_EQ(records[0].name, "ork_a");
+    EXPECT_EQ(records[1].type, DruidType);
+    EXPECT_EQ(records[1].x, -6);
+    EXPECT_EQ(records[1].y, 7);
+
+    ASSERT_EQ(errors.size(), 5u);
+    EXPECT_EQ(errors[0].line, 3u);
+    EXPECT_EQ(errors[0].message, "unexpected NPC type:7");
+    EXPECT_EQ(errors[1].line, 5u);
+    EXPECT_EQ(errors[2].line, 7u);
+    EXPECT_EQ(errors[2].message, "missing name");
+    EXPECT_EQ(errors[3].line, 8u);
+    EXPECT_EQ(errors[4].message, "expected 5 records, found 2");
+
+    EXPECT_EQ(parse_npc_records("many\n1 a 1 1\n", pool, records, errors), 0u);
+    EXPECT_TRUE(records.empty());
+    ASSERT_EQ(errors.size(), 1u);
+    EXPECT_EQ(errors[0].line, 1u);
+}
+
+TEST(Loader, ParallelLoadMatchesLoad)
+{
+    std::vector<std::shared_ptr<IFightObserver>> observers;
+    const auto npcs = make_random_world(20000, 1000, 5, observers);
+    const std::string filename = "npc_parallel_load.txt";
+    save(npcs, filename);
+
+    ThreadPool pool(3);
+    const auto expected = load(filename, observers);
+    const auto loaded = load_parallel(filename, observers, pool);
+    std::filesystem::remove(filename);
+
+    ASSERT_EQ(loaded.size(), expected.size());
+    for (size_t i = 0; i < loaded.size(); ++i)
+    {
+        EXPECT_EQ(loaded[i]->get_type(), expected[i]->get_type());
+        EXPECT_EQ(loaded[i]->get_name(), expected[i]->get_name());
+        EXPECT_EQ(loaded[i]->position(), expected[i]->position());
+    }
+
+    EXPECT_TRUE(load_parallel("no_such_file.txt", observers, pool).empty());
+}
+
+TEST(DeltaSave, AppendsOnlyChangedNpcs)
+{
+    std::vector<std::shared_ptr<IFightObserver>> observers;
+    auto npcs = make_random_world(1000, 500, 3, observers);
+    DeltaSaver saver("npc_delta_base.txt");
+
+    EXPECT_EQ(saver.append(npcs), 1000u); // первый вызов — полный снимок
+    EXPECT_EQ(saver.compactions(), 1u);
+    EXPECT_EQ(saver.append(npcs), 0u);
+
+    npcs[1]->move(1, 0, 500, 500);
+    npcs[2]->die();
+    npcs[3]->set_position(npcs[3]->get_x(), npcs[3]->get_y()); // без изменений
+    EXPECT_EQ(saver.append(npcs), 2u);
+
+    npcs.insert(factory(DruidType, "late_druid", 7, 8, observers));
+    npcs[4]->move(0, 1, 500, 500);
+    EXPECT_EQ(saver.append(npcs), 2u);
+    EXPECT_EQ(saver.pending_records(), 4u);
+    EXPECT_EQ(saver.compactions(), 1u);
+
+    auto check = [&](const set_t &loaded)
+    {
+        ASSERT_EQ(loaded.size(), npcs.size());
+        const auto names = sorted_names(npcs);
+        EXPECT_EQ(sorted_names(loaded), names);
+        std::unordered_map<std::string, std::shared_ptr<NPC>> by_name;
+        for (const auto &npc : loaded)
+        {
+            EXPECT_FALSE(npc->is_dirty());
+            by_name[npc->get_name()] = npc;
+        }
+        for (const auto &npc : npcs)
+        {
+            const auto &other = by_name[npc->get_name()];
+            EXPECT_EQ(other->position(), npc->position());
+            EXPECT_EQ(other->is_alive(), npc->is_alive());
+            EXPECT_EQ(other->get_type(), npc->get_type());
+        }
+    };
+    check(load_with_deltas(saver.base_path(), observers));
+
+    // Недописанный сегмент отбрасывается.
+    {
+        std::ofstream fs(saver.delta_path(), std::ios::app);
+        fs << "# segment 9 3\n1 ghost 1 1 1\n";
+    }
+    check(load_with_deltas(saver.base_path(), observers));
+
+    // Порог сжатия: больше половины мира изменилось — новый базовый снимок.
+    for (size_t i = 0; i < 600; ++i)
+        npcs[i]->move(1, 1, 500, 500);
+    saver.append(npcs);
+    EXPECT_EQ(saver.compactions(), 2u);
+    EXPECT_EQ(saver.pending_records(), 1u); // мёртвый npcs[2]
+    check(load_with_deltas(saver.base_path(), observers));
+
+    std::filesystem::remove(saver.base_path());
+    std::filesystem::remove(saver.delta_path());
+}
+
+TEST(DeltaSave, CrashDuringCompactionKeepsAConsistentPair)
+{
+    std::vector<std::shared_ptr<IFightObserver>> observers;
+    auto npcs = make_random_world(200, 100, 4, observers);
+    DeltaSaver saver("npc_delta_crash.txt", {1.0});
+    saver.append(npcs);
+    npcs[0]->die();
+    npcs[1]->move(3, 0, 100, 100);
+    saver.append(npcs);
+
+    auto state = [](const set_t &world)
+    {
+        std::vector<std::string> lines;
+        for (const auto &npc : world)
+        {
+            const auto [x, y] = npc->position();
+            lines.push_back(npc->get_name() + ' ' + std::to_string(x) + ' ' + std::to_string(y) + ' ' +
+                            std::to_string(npc->is_alive()));
+        }
+        std::sort(lines.begin(), lines.end());
+        return lines;
+    };
+    const auto before = state(npcs);
+    ASSERT_EQ(state(load_with_deltas(saver.base_path(), observers)), before);
+
+    // Сбой до rename(): недописанный временный файл не мешает прежней паре.
+    {
+        std::ofstream fs(saver.base_path() + ".tmp");
+        fs << "200\n1 half";
+    }
+    EXPECT_EQ(state(load_with_deltas(saver.base_path(), observers)), before);
+
+    // Сбой между rename() и сбросом журнала: старый журнал с чужой меткой игнорируется,
+    // мёртвые берутся из самого снимка.
+    std::string old_journal;
+    {
+        std::ifstream is(saver.delta_path());
+        old_journal.assign(std::istreambuf_iterator<char>(is), {});
+    }
+    npcs[1]->move(-3, 0, 100, 100);
+    npcs[2]->die();
+    ASSERT_TRUE(saver.compact(npcs));
+    EXPECT_FALSE(std::filesystem::exists(saver.base_path() + ".tmp"));
+    {
+        std::ofstream fs(saver.delta_path(), std::ios::trunc);
+        fs << old_journal;
+    }
+    EXPECT_EQ(state(load_with_deltas(saver.base_path(), observers)), state(npcs));
+
+    std::filesystem::remove(saver.base_path());
+    std::filesystem::remove(saver.delta_path());
+}
+
+TEST(DeltaSave, FailedJournalResetForcesCompactionAndDuplicateNamesAreRejected)
+{
+    std::vector<std::shared_ptr<IFightObserver>> observers;
+    auto npcs = make_random_world(100, 100, 5, observers);
+    DeltaSaver saver("npc_delta_retry.txt");
+    ASSERT_EQ(saver.append(npcs), 100u);
+
+    // Журнал нельзя обнулить (на его месте каталог): снимок уже подменён, но сжатие
+    // считается неудачным, и следующие append() снова пишут полный снимок.
+    std::filesystem::remove(saver.delta_path());
+    std::filesystem::create_directory(saver.delta_path());
+    npcs[0]->move(1, 1, 100, 100);
+    EXPECT_FALSE(saver.compact(npcs));
+    EXPECT_EQ(saver.compactions(), 1u);
+    npcs[1]->die();
+    saver.append(npcs);
+    EXPECT_EQ(saver.compactions(), 1u);
+
+    std::filesystem::remove(saver.delta_path());
+    npcs[2]->move(-1, 0, 100, 100);
+    saver.append(npcs);
+    EXPECT_EQ(saver.compactions(), 2u);
+    const auto loaded = load_with_deltas(saver.base_path(), observers);
+    ASSERT_EQ(loaded.size(), npcs.size());
+    for (size_t i = 0; i < 3; ++i)
+    {
+        const auto &npc = loaded[i]; // снимок хранит порядок массива
+        EXPECT_EQ(npc->get_name(), npcs[i]->get_name());
+        EXPECT_EQ(npc->position(), npcs[i]->position());
+        EXPECT_EQ(npc->is_alive(), npcs[i]->is_alive());
+    }
+
+    // Записи журнала идут по имени: мир с повторяющимися именами не загружается.
+    npcs.insert(factory(OrkType, npcs[5]->get_name(), 1, 1, observers));
+    saver.compact(npcs);
+    EXPECT_TRUE(load_with_deltas(saver.base_path(), observers).empty());
+
+    std::filesystem::remove(saver.base_path());
+    std::filesystem::remove(saver.delta_path());
+}
+
+namespace
+{
+    struct KillLog
+    {
+        static constexpr FightFilter filter = FightFilter::Wins;
+
+        std::vector<std::string> logs;
+
+        void on_fight(const FightEvent &event)
+        {
+            logs.push_back(event.attacker.get_name() + "->" + event.defender.get_name());
+        }
+    };
+}
+
+TEST(StaticObservers, MatchRuntimeObservers)
+{
+    static_assert(Observers<>::empty);
+
+    auto runtime_log = std::make_shared<LoggingObserver>();
+    auto runtime_world = make_random_world(3000, 200, 21, {runtime_log});
+    ObservedWorld<KillLog, FightCounter<FightFilter::Wins>, FightCounter<FightFilter::Losses>> static_world(
+        make_random_world(3000, 200, 21, {}));
+    ObservedWorld<> silent_world(make_random_world(3000, 200, 21, {}));
+
+    seed_random(9);
+    const auto runtime_dead = fight(runtime_world, 10);
+    seed_random(9);
+    const auto static_dead = static_world.fight(10);
+    seed_random(9);
+    const auto silent_dead = silent_world.fight(10);
+
+    ASSERT_FALSE(runtime_dead.empty());
+    EXPECT_EQ(sorted_names(static_dead), sorted_names(runtime_dead));
+    EXPECT_EQ(sorted_names(silent_dead), sorted_names(runtime_dead));
+    auto &observers = static_world.observers();
+    EXPECT_EQ(observers.get<KillLog>().logs, runtime_log->logs);
+    EXPECT_EQ(observers.get<FightCounter<FightFilter::Wins>>().events, runtime_dead.size());
+    EXPECT_GT(observers.get<FightCounter<FightFilter::Losses>>().events, 0u);
+
+    // Второй раунд на том же мире: резолвер сбрасывается, погибшие в боях не участвуют.
+    const size_t wins = observers.get<FightCounter<FightFilter::Wins>>().events;
+    for (const auto &npc : static_dead)
+        static_world.npcs().erase(npc);
+    seed_random(10);
+    const auto second = static_world.fight(10);
+    EXPECT_EQ(observers.get<FightCounter<FightFilter::Wins>>().events, wins + second.size());
+}
+
+TEST(Density, RectangleCountsMatchScan)
+{
+    auto npcs = make_random_world(2000, 100, 17, {});
+    DensityGrid grid(100, 100);
+    DensityGrid coarse(100, 100, 10);
+    grid.rebuild(npcs);
+    coarse.rebuild(npcs);
+
+    std::mt19937 rng(4);
+    std::uniform_int_distribution<int> coord(-5, 105);
+    std::uniform_int_distribution<int> shift(-3, 3);
+    auto brute = [&](NpcType type, int x0, int y0, int x1, int y1)
+    {
+        size_t n = 0;
+        for (const auto &npc : npcs)
+        {
+            const auto [x, y] = npc->position();
+            if (npc->is_alive() && npc->get_type() == type && x >= x0 && x <= x1 && y >= y0 && y <= y1)
+                ++n;
+        }
+        return n;
+    };
+
+    for (size_t round = 0; round < 3; ++round)
+    {
+        for (int q = 0; q < 200; ++q)
+        {
+            int x0 = coord(rng), x1 = coord(rng), y0 = coord(rng), y1 = coord(rng);
+            if (x0 > x1)
+                std::swap(x0, x1);
+            if (y0 > y1)
+                std::swap(y0, y1);
+            for (auto type : {OrkType, SquirrelType, DruidType})
+            {
+                EXPECT_EQ(grid.count(type, x0, y0, x1, y1), brute(type, x0, y0, x1, y1));
+                // Выровненные по ячейкам 10x10 прямоугольники считаются точно и грубой сеткой.
+                const int cx = std::clamp(x0, 0, 100) / 10, cy = std::clamp(y0, 0, 100) / 10;
+                EXPECT_EQ(coarse.count_cells(type, cx, cy, cx + 3, cy + 2),
+                          brute(type, cx * 10, cy * 10, cx * 10 + 29, cy * 10 + 19));
+            }
+        }
+
+        // Счётчики правятся по одному, как в путях движения и смерти.
+        for (size_t i = 0; i < npcs.size(); ++i)
+        {
+            auto &npc = *npcs[i];
+            if (!npc.is_alive())
+                continue;
+            const auto [x, y] = npc.position();
+            if (i % 7 == round)
+            {
+                npc.die();
+                grid.remove(npc.get_type(), x, y);
+                coarse.remove(npc.get_type(), x, y);
+                continue;
+            }
+            npc.move(shift(rng), shift(rng), 100, 100);
+            const auto [nx, ny] = npc.position();
+            grid.move(npc.get_type(), x, y, nx, ny);
+            coarse.move(npc.get_type(), x, y, nx, ny);
+        }
+    }
+
+    size_t alive = 0;
+    for (const auto &npc : npcs)
+        alive += npc->is_alive();
+    EXPECT_EQ(grid.total(OrkType) + grid.total(SquirrelType) + grid.total(DruidType), alive);
+    EXPECT_EQ(grid.count_cells(OrkType, 0, 0, grid.columns(), grid.rows()), grid.total(OrkType));
+}
+
+TEST(Density, FollowsBehaviourStepsAndFightDeaths)
+{
+    auto npcs = make_random_world(2000, 100, 23, {});
+    DensityGrid grid(100, 100, 5);
+    grid.rebuild(npcs);
+
+    BehaviourScheduler behaviours(100, 100, 8);
+    behaviours.context().density = &grid;
+    for (const auto &npc : npcs)
+        behaviours.spawn(wander(npc, behaviours.context()));
+
+    FightResolver resolver;
+    for (int tick = 0; tick < 5; ++tick)
+    {
+        behaviours.tick();
+        std::vector<FightCandidate> candidates;
+        for (std::uint32_t i = 0; i + 1 < npcs.size(); i += 9)
+            candidates.push_back({i, i + 1});
+        resolver.resolve(npcs, candidates, 100 + tick);
+        grid.remove_killed(npcs, resolver.outcomes());
+    }
+
+    DensityGrid expected(100, 100, 5);
+    expected.rebuild(npcs);
+    size_t alive = 0;
+    for (const auto &npc : npcs)
+        alive += npc->is_alive();
+    ASSERT_LT(alive, npcs.size());
+    for (auto type : {OrkType, SquirrelType, DruidType})
+    {
+        EXPECT_EQ(grid.total(type), expected.total(type));
+        for (int cy = 0; cy < grid.rows(); ++cy)
+            for (int cx = 0; cx < grid.columns(); ++cx)
+                ASSERT_EQ(grid.cell(type, cx, cy), expected.cell(type, cx, cy));
+    }
+}
+
+TEST(Partition, TiledCandidatesAndCostRebalance)
+{
+    // Пятая часть населения — в углу 60x60 карты 1000x1000.
+    std::mt19937 rng(12);
+    std::uniform_int_distribution<int> wide(0, 1000);
+    std::uniform_int_distribution<int> corner(0, 60);
+    std::uniform_int_distribution<int> type(1, 3);
+    set_t npcs;
+    for (int i = 0; i < 3000; ++i)
+    {
+        const bool clustered = i % 5 == 0;
+        const int x = clustered ? corner(rng) : wide(rng);
+        const int y = clustered ? corner(rng) : wide(rng);
+        npcs.insert(factory(static_cast<NpcType>(type(rng)), "p" + std::to_string(i), x, y, {}));
+    }
+
+    SpatialIndex index;
+    index.rebuild(npcs);
+    ThreadPool pool(3);
+    AdaptivePartitioner partition(8, 1);
+    std::vector<FightCandidate> tiled;
+    collect_candidates_tiled(npcs, index, partition, pool, tiled);
+    ASSERT_EQ(partition.tile_count(), 8u);
+
+    std::vector<FightCandidate> expected;
+    for (size_t i = 0; i < npcs.size(); ++i)
+        for (size_t j = 0; j < npcs.size(); ++j)
+            if (can_attack(npcs[i]->get_type(), npcs[j]->get_type()) &&
+                npcs[i]->is_close(npcs[j], static_cast<size_t>(rules_for(npcs[i]->get_type()).kill_distance)))
+                expected.push_back({static_cast<std::uint32_t>(i), static_cast<std::uint32_t>(j)});
+    ASSERT_EQ(tiled.size(), expected.size());
+    for (size_t k = 0; k < tiled.size(); ++k)
+    {
+        EXPECT_EQ(tiled[k].attacker, expected[k].attacker);
+        EXPECT_EQ(tiled[k].defender, expected[k].defender);
+    }
+
+    // Синтетическая стоимость: NPC из скопления в 20 раз дороже. Первое разбиение делит
+    // NPC поровну, поэтому по стоимости оно перекошено; после перестройки — ровнее.
+    AdaptivePartitioner balanced(8, 1);
+    auto cost_of = [&](size_t t)
+    {
+        long long cost = 0;
+        for (const auto i : balanced.members(t))
+            cost += npcs[i]->get_x() <= 60 && npcs[i]->get_y() <= 60 ? 20 : 1;
+        return std::chrono::nanoseconds(cost * 1000);
+    };
+    auto measure = [&]()
+    {
+        balanced.assign(npcs);
+        for (size_t t = 0; t < balanced.tile_count(); ++t)
+            balanced.record(t, cost_of(t));
+        balanced.end_tick(npcs);
+        return balanced.imbalance();
+    };
+    const double before = measure();
+    measure();
+    const double after = measure();
+    EXPECT_EQ(balanced.rebalances(), 3u);
+    EXPECT_GT(before, 2.0);
+    EXPECT_LT(after, 1.5);
+}
+
+TEST(Trace, ScopesExportAsChromeTrace)
+{
+    trace_disable();
+    trace_clear();
+    {
+        TRACE_SCOPE("disabled_span");
+    }
+    EXPECT_EQ(trace_event_count(), 0u);
+
+    trace_enable(4);
+    std::thread worker([]()
+                       {
+        trace_thread_name("trace_worker");
+        for (int i = 0; i < 10; ++i)
+        {
+            TRACE_SCOPE("worker_span");
+        } });
+    worker.join();
+    {
+        TRACE_SCOPE("main_span");
+        auto npcs = make_random_world(50, 20, 2, {});
+        fight(npcs, 5);
+    }
+    trace_disable();
+
+    std::ostringstream os;
+    trace_write_chrome(os);
+    const std::string json = os.str();
+    EXPECT_EQ(json.rfind("{\"traceEvents\":[", 0), 0u);
+    EXPECT_NE(json.find("\"name\":\"trace_worker\""), std::string::npos);
+    EXPECT_NE(json.find("\"name\":\"worker_span\",\"ph\":\"X\""), std::string::npos);
+    EXPECT_NE(json.find("\"name\":\"main_span\""), std::string::npos);
+    EXPECT_NE(json.find("\"name\":\"fight\","), std::string::npos);
+    EXPECT_EQ(json.find("disabled_span"), std::string::npos);
+
+    // Кольцо рабочего потока на 4 события: остались только последние.
+    size_t worker_spans = 0;
+    for (size_t pos = json.find("worker_span"); pos != std::string::npos; pos = json.find("worker_span", pos + 1))
+        ++worker_spans;
+    EXPECT_EQ(worker_spans, 4u);
+    trace_clear();
+}
+
+TEST(Trace, ExportWhileOwnerWritesSeesOnlyWholeEvents)
+{
+    trace_clear();
+    trace_enable(64);
+    std::atomic<bool> stop{false};
+    std::atomic<size_t> spans{0};
+    std::thread writer([&]()
+                       {
+        trace_thread_name("trace_writer");
+        while (!stop.load())
+        {
+            {
+                TRACE_SCOPE("hot_span");
+            }
+            spans.fetch_add(1);
+        } });
+    // Ждём записанных событий: под нагрузкой поток может ещё не успеть стартовать.
+    auto wait_for_spans = [&](size_t at_least)
+    {
+        while (spans.load() < at_least)
+            std::this_thread::yield();
+    };
+    wait_for_spans(1);
+
+    // Кольцо пишется без блокировок; экспорт сбоку не должен видеть рваных событий.
+    for (int i = 0; i < 200; ++i)
+    {
+        std::ostringstream os;
+        trace_write_chrome(os);
+        const std::string json = os.str();
+        for (size_t pos = json.find("\"ph\":\"X\""); pos != std::string::npos; pos = json.find("\"ph\":\"X\"", pos + 1))
+        {
+            const size_t name = json.rfind("{\"name\":\"", pos);
+            ASSERT_NE(name, std::string::npos);
+            const std::string span = json.substr(name + 9, pos - name - 11);
+            ASSERT_FALSE(span.empty());
+        }
+        EXPECT_LE(trace_event_count(), 64u * 8);
+    }
+    wait_for_spans(spans.load() + 1);
+    stop = true;
+    writer.join();
+    trace_disable();
+    EXPECT_GT(trace_event_count(), 0u);
+    trace_clear();
+    EXPECT_EQ(trace_event_count(), 0u);
+}
+
+TEST(SnapshotServer, ServesSnapshotsToClientProcesses)
+{
+    const std::string path = (std::filesystem::temp_directory_path() / ("npc_snap_" + std::to_string(::getpid()))).string();
+    SnapshotServer server(path);
+    ASSERT_TRUE(server.start());
+
+    std::string error;
+    EXPECT_TRUE(query_snapshot(path, "COUNTS", &error).empty());
+    EXPECT_EQ(error, "ERR no snapshot yet");
+
+    auto kills = std::make_shared<RecentKillsObserver>(2);
+    set_t npcs;
+    npcs.insert(factory(OrkType, "snap_ork", 1, 2, {kills}));
+    npcs.insert(factory(DruidType, "snap_druid", 3, 4, {kills}));
+    npcs.insert(factory(SquirrelType, "snap_sq", 5, 6, {kills}));
+    npcs[1]->die();
+    kills->on_fight(npcs[0], npcs[1], true);
+    server.publish(WorldSnapshot::capture(npcs, 1, kills->recent()));
+
+    EXPECT_EQ(query_snapshot(path, "VERSION"), "1\n");
+    EXPECT_EQ(query_snapshot(path, "COUNTS"), "Ork 1\nSquirrel 1\nDruid 0\n");
+    EXPECT_EQ(query_snapshot(path, "POSITIONS"), "Ork snap_ork 1 2\nSquirrel snap_sq 5 6\n");
+    EXPECT_EQ(query_snapshot(path, "KILLS"), "Ork snap_ork {1, 2} -> Druid snap_druid {3, 4}\n");
+    EXPECT_TRUE(query_snapshot(path, "HELLO", &error).empty());
+    EXPECT_EQ(error, "ERR unknown command");
+
+    // Клиенты-процессы читают, пока симуляция публикует новые версии: версия не убывает.
+    std::vector<pid_t> children;
+    for (int c = 0; c < 4; ++c)
+    {
+        const pid_t pid = ::fork();
+        ASSERT_GE(pid, 0);
+        if (pid == 0)
+        {
+            unsigned long long last = 0;
+            for (int q = 0; q < 50; ++q)
+            {
+                const auto version = query_snapshot(path, "VERSION");
+                const auto counts = query_snapshot(path, "COUNTS");
+                if (version.empty() || counts.empty())
+                    ::_exit(1);
+                const auto v = std::stoull(version);
+                if (v < last)
+                    ::_exit(2);
+                last = v;
+            }
+            ::_exit(0);
+        }
+        children.push_back(pid);
+    }
+    for (std::uint64_t version = 2; version < 200; ++version)
+    {
+        npcs[0]->move(1, 0, 1000, 1000);
+        server.publish(WorldSnapshot::capture(npcs, version, kills->recent()));
+    }
+    for (const pid_t pid : children)
+    {
+        int status = 0;
+        ASSERT_EQ(::waitpid(pid, &status, 0), pid);
+        EXPECT_TRUE(WIFEXITED(status));
+        EXPECT_EQ(WEXITSTATUS(status), 0);
+    }
+
+    EXPECT_EQ(query_snapshot(path, "VERSION"), "199\n");
+    EXPECT_GE(server.served(), 4u * 100u + 7u);
+    server.stop();
+    EXPECT_FALSE(std::filesystem::exists(path));
+}
+
+TEST(SnapshotServer, ReusesNamesAndAnswersHalfClosedClients)
+{
+    const std::string path = (std::filesystem::temp_directory_path() / ("npc_snap_hc_" + std::to_string(::getpid()))).string();
+    SnapshotServer server(path);
+    ASSERT_TRUE(server.start());
+
+    set_t npcs;
+    npcs.insert(factory(OrkType, "hc_ork", 1, 2, {}));
+    npcs.insert(factory(SquirrelType, "hc_sq", 5, 6, {}));
+    const auto first = WorldSnapshot::capture(npcs, 1, {});
+    npcs[0]->move(1, 1, 100, 100);
+    const auto second = WorldSnapshot::capture(npcs, 2, {}, first);
+    // Раскладка та же — таблица имён общая; текст собирается из POD-копии.
+    EXPECT_EQ(second->names, first->names);
+    EXPECT_EQ(second->positions(), "Ork hc_ork 2 3\nSquirrel hc_sq 5 6\n");
+    EXPECT_EQ(first->positions(), "Ork hc_ork 1 2\nSquirrel hc_sq 5 6\n");
+    server.publish(second);
+
+    // Клиент шлёт запросы и сразу закрывает запись: ответы всё равно приходят целиком.
+    const int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    ASSERT_GE(fd, 0);
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+    ASSERT_EQ(::connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)), 0);
+    const std::string request = "VERSION\nCOUNTS\nPOSITIONS\n";
+    ASSERT_EQ(::send(fd, request.data(), request.size(), MSG_NOSIGNAL), static_cast<ssize_t>(request.size()));
+    ASSERT_EQ(::shutdown(fd, SHUT_WR), 0);
+
+    std::string reply;
+    char buffer[256];
+    ssize_t n;
+    while ((n = ::read(fd, buffer, sizeof(buffer))) > 0)
+        reply.append(buffer, static_cast<size_t>(n));
+    ::close(fd);
+    EXPECT_EQ(reply, "OK 2 2\n2\n"
+                     "OK 2 25\nOrk 1\nSquirrel 1\nDruid 0\n"
+                     "OK 2 34\nOrk hc_ork 2 3\nSquirrel hc_sq 5 6\n");
+    server.stop();
+}
+
+TEST(SnapshotServer, KeepsNonSocketPathsAndRejectsMalformedHeaders)
+{
+    const std::string path = (std::filesystem::temp_directory_path() / ("npc_snap_path_" + std::to_string(::getpid()))).string();
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+
+    // Обычный файл по пути сокета: start() отказывается и файл не трогает.
+    {
+        std::ofstream(path) << "keep";
+        SnapshotServer server(path);
+        EXPECT_FALSE(server.start());
+        server.stop();
+        std::ifstream in(path);
+        std::string content;
+        in >> content;
+        EXPECT_EQ(content, "keep");
+        std::filesystem::remove(path);
+    }
+
+    // Сокет, оставшийся от упавшего процесса, заменяется.
+    {
+        const int stale = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        ASSERT_EQ(::bind(stale, reinterpret_cast<sockaddr *>(&address), sizeof(address)), 0);
+        ::close(stale);
+        SnapshotServer server(path);
+        EXPECT_TRUE(server.start());
+        server.stop();
+        EXPECT_FALSE(std::filesystem::exists(path));
+    }
+
+    // Поддельный сервер с испорченными заголовками: query_snapshot не падает, а сообщает ошибку.
+    const std::vector<std::string> headers = {"OK 1 abc\n", "OK 1\n", "OK x 3\nabc", "OK 1 3 4\nabc",
+                                              "OK 1 99999999999999999999999\n"};
+    const int listener = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    ASSERT_EQ(::bind(listener, reinterpret_cast<sockaddr *>(&address), sizeof(address)), 0);
+    ASSERT_EQ(::listen(listener, 4), 0);
+    std::thread fake([&]()
+                     {
+        for (const auto &header : headers)
+        {
+            const int client = ::accept(listener, nullptr, nullptr);
+            if (client < 0)
+                return;
+            char buffer[64];
+            [[maybe_unused]] const auto request = ::read(client, buffer, sizeof(buffer));
+            [[maybe_unused]] const auto written = ::send(client, header.data(), header.size(), MSG_NOSIGNAL);
+            ::close(client);
+        } });
+    for (const auto &header : headers)
+    {
+        std::string error;
+        EXPECT_TRUE(query_snapshot(path, "COUNTS", &error).empty()) << header;
+        EXPECT_EQ(error.rfind("malformed header", 0), 0u) << header << " -> " << error;
+    }
+    fake.join();
+    ::close(listener);
+    std::filesystem::remove(path);
+}
+
+TEST(TimerWheel, FiresOnTimeAcrossLevelsAndCancels)
+{
+    TimerWheel wheel;
+    std::mt19937 rng(8);
+    std::uniform_int_distribution<std::uint64_t> delay(0, 200000);
+    std::vector<std::uint64_t> due;
+    std::vector<TimerId> ids;
+    std::vector<bool> cancelled;
+    for (size_t i = 0; i < 20000; ++i)
+    {
+        const auto d = delay(rng);
+        ids.push_back(wheel.schedule(d, i));
+        due.push_back(std::max<std::uint64_t>(d, 1));
+        cancelled.push_back(i % 3 == 0);
+    }
+    for (size_t i = 0; i < ids.size(); i += 3)
+        EXPECT_TRUE(wheel.cancel(ids[i]));
+    EXPECT_FALSE(wheel.cancel(ids[0]));
+
+    std::vector<std::uint64_t> fired_at(ids.size(), 0);
+    size_t rescheduled = 0;
+    std::uniform_int_distribution<std::uint64_t> step(1, 5000);
+    while (wheel.now() < 210000)
+    {
+        wheel.advance_to(wheel.now() + step(rng), [&](TimerId, std::uint64_t payload)
+                         {
+            if (payload >= ids.size())
+            {
+                ++rescheduled;
+                return;
+            }
+            EXPECT_EQ(fired_at[payload], 0u);
+            fired_at[payload] = wheel.now();
+            // Из обработчика можно ставить новые таймеры.
+            if (payload % 1000 == 1)
+                wheel.schedule(300, ids.size() + payload); });
+    }
+
+    for (size_t i = 0; i < ids.size(); ++i)
+    {
+        if (cancelled[i])
+            EXPECT_EQ(fired_at[i], 0u) << i;
+        else
+            EXPECT_EQ(fired_at[i], due[i]) << i;
+    }
+    size_t expected_rescheduled = 0;
+    for (size_t i = 1; i < ids.size(); i += 1000)
+        expected_rescheduled += !cancelled[i];
+    EXPECT_EQ(rescheduled, expected_rescheduled);
+    EXPECT_EQ(wheel.size(), 0u);
+
+    // Миллион «кулдаунов»: постановка и отмена без срабатываний, узлы переиспользуются.
+    std::vector<TimerId> cooldowns;
+    cooldowns.reserve(1000000);
+    wheel.reserve(1000000);
+    for (std::uint64_t npc = 0; npc < 1000000; ++npc)
+        cooldowns.push_back(wheel.schedule(1000 + npc % 50000, npc));
+    EXPECT_EQ(wheel.size(), 1000000u);
+    EXPECT_LE(wheel.ticks_until_next(10000), 1000u);
+    for (const auto id : cooldowns)
+        EXPECT_TRUE(wheel.cancel(id));
+    EXPECT_EQ(wheel.size(), 0u);
+    EXPECT_EQ(wheel.advance_to(wheel.now() + 100000, [](TimerId, std::uint64_t) {}), 0u);
+}
+
+TEST(TimerWheel, AttackCooldownsSurvivePermuteAndExpire)
+{
+    set_t npcs;
+    for (int i = 0; i < 6; ++i)
+        npcs.insert(factory(i % 2 ? SquirrelType : OrkType, "cd_" + std::to_string(i), i, 0, {}));
+    AttackCooldowns cooldowns(50);
+    const NpcId ork = npcs.id_at(0);
+    const NpcId other_ork = npcs.id_at(2);
+
+    const std::vector<FightOutcome> outcomes{{0, 1, true}, {2, 3, false}};
+    cooldowns.start(npcs, outcomes);
+    EXPECT_TRUE(cooldowns.resting(ork));
+    EXPECT_FALSE(cooldowns.resting(other_ork));
+    EXPECT_EQ(cooldowns.active(), 1u);
+
+    // Перезарядка привязана к NpcId, а не к плотному индексу.
+    npcs.permute({4, 5, 2, 3, 0, 1});
+    std::vector<FightCandidate> batch{{4, 5}, {2, 3}, {0, 1}};
+    cooldowns.advance_to(49);
+    cooldowns.filter(npcs, batch);
+    ASSERT_EQ(batch.size(), 2u);
+    EXPECT_EQ(batch[0].attacker, 2u);
+    EXPECT_EQ(batch[1].attacker, 0u);
+
+    cooldowns.advance_to(50);
+    EXPECT_FALSE(cooldowns.resting(ork));
+    EXPECT_EQ(cooldowns.active(), 0u);
+    batch = {{4, 5}};
+    cooldowns.filter(npcs, batch);
+    EXPECT_EQ(batch.size(), 1u);
+}
+
+TEST(Placement, NodeChunksRunOnTheirNodeAndRestoreAffinity)
+{
+    cpu_set_t original;
+    ASSERT_EQ(sched_getaffinity(0, sizeof(original), &original), 0);
+    // Два узла на одном CPU: привязка наблюдаема даже на однопроцессорной машине.
+    const NumaTopology topology({{0}, {0}});
+    EXPECT_EQ(topology.node_of(0, 100), 0u);
+    EXPECT_EQ(topology.node_of(49, 100), 0u);
+    EXPECT_EQ(topology.node_of(50, 100), 1u);
+    EXPECT_EQ(topology.node_of(99, 100), 1u);
+
+    ThreadPool pool(2);
+    std::vector<int> visited(1000, 0);
+    std::atomic<size_t> bound_chunks{0};
+    parallel_for_on_nodes(pool, visited.size(), topology, true, [&](size_t begin, size_t end)
+                          {
+        cpu_set_t now;
+        sched_getaffinity(0, sizeof(now), &now);
+        if (CPU_COUNT(&now) == 1 && CPU_ISSET(0, &now))
+            ++bound_chunks;
+        for (size_t i = begin; i < end; ++i)
+            ++visited[i]; });
+    EXPECT_EQ(bound_chunks.load(), std::min<size_t>(visited.size(), pool.size() + 1));
+    EXPECT_TRUE(std::all_of(visited.begin(), visited.end(), [](int v)
+                            { return v == 1; }));
+
+    cpu_set_t after;
+    ASSERT_EQ(sched_getaffinity(0, sizeof(after), &after), 0);
+    EXPECT_TRUE(CPU_EQUAL(&original, &after));
+    EXPECT_GE(NumaTopology::system().nodes(), 1u);
+}
+
+TEST(Placement, PlacedWorldMovesLikePlainWorld)
+{
+    ThreadPool pool(3);
+    PackedWorld plain;
+    PackedWorld placed({HugePages::Transparent, true, true});
+    for (int i = 0; i < 300000; ++i)
+    {
+        plain.add(static_cast<NpcType>(1 + i % 3), "", i % 1009, i % 997);
+        placed.add(static_cast<NpcType>(1 + i % 3), "", i % 1009, i % 997);
+    }
+    placed.place(pool);
+    // Крупный буфер идёт через mmap и выровнен на huge-страницу.
+    EXPECT_EQ(reinterpret_cast<std::uintptr_t>(placed.records().data()) % (2 * 1024 * 1024), 0u);
+
+    for (std::uint64_t tick = 0; tick < 5; ++tick)
+    {
+        move_packed(plain.records(), 1000, 1000, tick, pool);
+        move_packed(placed, 1000, 1000, tick, pool);
+    }
+    ASSERT_EQ(plain.size(), placed.size());
+    EXPECT_EQ(std::memcmp(plain.records().data(), placed.records().data(), plain.size() * sizeof(NpcHot)), 0);
+
+    std::vector<FightOutcome> plain_out, placed_out;
+    PackedFightScratch scratch(HugePages::Transparent);
+    fight_packed(plain, 3, 11, plain_out);
+    fight_packed(placed, 3, 11, placed_out, scratch);
+    ASSERT_EQ(plain_out.size(), placed_out.size());
+    for (size_t i = 0; i < plain_out.size(); ++i)
+    {
+        EXPECT_EQ(plain_out[i].attacker, placed_out[i].attacker);
+        EXPECT_EQ(plain_out[i].defender, placed_out[i].defender);
+        EXPECT_EQ(plain_out[i].win, placed_out[i].win);
+    }
+}
+
+TEST(ThreadPool, ParallelForWaitsForAllChunksBeforeRethrowing)
+{
+    ThreadPool pool(3);
+    std::atomic<size_t> finished{0};
+    auto run = [&](size_t throwing_begin)
+    {
+        pool.parallel_for(4, [&](size_t begin, size_t)
+                          {
+            if (begin == throwing_begin)
+                throw std::runtime_error("chunk");
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            ++finished; });
+    };
+
+    // Бросает кусок вызывающего потока: остальные три должны завершиться до выхода.
+    EXPECT_THROW(run(0), std::runtime_error);
+    EXPECT_EQ(finished.load(), 3u);
+    finished = 0;
+    EXPECT_THROW(run(2), std::runtime_error);
+    EXPECT_EQ(finished.load(), 3u);
+}